@@ -0,0 +1,155 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "bench_Utils.h"
+
+#include "Clock.h"
+#include "ThreadPool.h"
+
+#include <memory>
+#include <vector>
+
+#include <sched.h>
+#include <unistd.h>
+
+// -----------------------------------------------------------------------------
+
+namespace {
+
+// A task is issued every 100 microseconds:
+const std::uint64_t INTERVAL_NS = 100000;
+
+// Tasks issued before the measurement starts:
+const std::size_t WARMUP = 1000;
+
+class JitterTask
+        :
+                public ITask
+{
+
+public:
+
+    std::uint64_t m_intended_ns;
+    std::uint64_t m_start_ns;
+
+    explicit JitterTask(std::uint64_t intended_ns)
+            :
+            m_intended_ns(intended_ns),
+            m_start_ns(0)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        m_start_ns = clock_now_ns();
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+void
+bench_jitter_run(const BenchConfig &config,
+                 const char *name,
+                 const ThreadPoolOptions &options,
+                 BenchResults &results)
+{
+    const std::size_t count = std::size_t(config.seconds * 1e9 / INTERVAL_NS);
+
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(options));
+    Histogram latency;
+
+    std::shared_ptr<JitterTask> task;
+    std::uint64_t begin = clock_now_ns();
+    for (std::size_t i = 0; i < WARMUP + count; ++i)
+    {
+        std::uint64_t intended = begin + i * INTERVAL_NS;
+        while (clock_now_ns() < intended)
+        {
+            ::sched_yield();
+        }
+
+        pool->push(std::make_shared<JitterTask>(intended));
+
+        // Keeps the output queue short, the previous tasks are done by now:
+        while (pool->popT(task, false) > 0)
+        {
+            if (task->m_intended_ns >= begin + WARMUP * INTERVAL_NS)
+            {
+                latency.record(task->m_start_ns - task->m_intended_ns);
+            }
+        }
+    }
+    std::uint64_t end = clock_now_ns();
+
+    pool->shutdown(IThreadPool::SHUTDOWN_DRAIN);
+    while (pool->popT(task, true) > 0)
+    {
+        if (task->m_intended_ns >= begin + WARMUP * INTERVAL_NS)
+        {
+            latency.record(task->m_start_ns - task->m_intended_ns);
+        }
+    }
+
+    BenchResult result("jitter", name, options.num_threads);
+    result.operations = count;
+    result.seconds = bench_seconds(begin + WARMUP * INTERVAL_NS, end);
+    latency.snapshot(result.latency);
+    results.push_back(result);
+}
+
+} // anonymous namespace
+
+// -----------------------------------------------------------------------------
+
+/**
+ * Wake-up jitter: a single worker receives a task at a fixed interval and the
+ * delay between the intended and the actual start of each task is measured.
+ * The worst case matters more than the average here, so the maximum is
+ * reported along with the percentiles. The low-latency profile is compared
+ * only when a processor is left to the generator.
+ */
+void
+bench_jitter(const BenchConfig &config, BenchResults &results)
+{
+    bench_jitter_run(config, "default", ThreadPoolOptions(1), results);
+
+    const long cpus = ::sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > 1)
+    {
+        bench_jitter_run(config,
+                         "low_latency",
+                         ThreadPoolOptions::low_latency(
+                                 std::vector<std::size_t>(1, cpus - 1)),
+                         results);
+    }
+}
+
+// -----------------------------------------------------------------------------
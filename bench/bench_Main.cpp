@@ -0,0 +1,281 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "bench_Utils.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+void bench_queue(const BenchConfig &config, BenchResults &results);
+void bench_latency(const BenchConfig &config, BenchResults &results);
+void bench_empty(const BenchConfig &config, BenchResults &results);
+void bench_scaling(const BenchConfig &config, BenchResults &results);
+void bench_openloop(const BenchConfig &config, BenchResults &results);
+void bench_jitter(const BenchConfig &config, BenchResults &results);
+
+// -----------------------------------------------------------------------------
+
+namespace {
+
+const double PERCENTILES[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+
+void
+usage(const char *program)
+{
+    std::cerr
+        << "Usage: " << program << " [options]\n"
+        << "  --suite=NAME      all, queue, latency, empty, scaling,"
+           " openloop or jitter\n"
+        << "                    (default all)\n"
+        << "  --threads=N       greatest number of threads"
+           " (default: online CPUs)\n"
+        << "  --operations=N    operations for each run (default 100000)\n"
+        << "  --duration=S      seconds for each open-loop step"
+           " (default 1)\n"
+        << "  --rate=R          initial open-loop rate in tasks/s, doubled"
+           " at each step\n"
+        << "                    until saturation (default 1000)\n"
+        << "  --arrivals=KIND   open-loop arrivals: poisson or constant"
+           " (default poisson)\n"
+        << "  --format=FORMAT   csv or json (default csv)\n";
+}
+
+bool
+parse_option(const char *arg, const char *name, std::string &value)
+{
+    std::size_t length = std::strlen(name);
+    if (std::strncmp(arg, name, length) == 0 && arg[length] == '=')
+    {
+        value = arg + length + 1;
+        return true;
+    }
+
+    return false;
+}
+
+} // anonymous namespace
+
+// -----------------------------------------------------------------------------
+
+void
+bench_write_csv(std::ostream &stream, const BenchResults &results)
+{
+    stream << "suite,name,threads,operations,seconds,ops_per_second";
+    for (auto percentile: PERCENTILES)
+    {
+        stream << ",p" << percentile << "_ns";
+    }
+    stream << ",max_ns\n";
+
+    for (auto &result: results)
+    {
+        stream << result.suite << ',' << result.name << ','
+               << result.threads << ',' << result.operations << ','
+               << result.seconds << ','
+               << double(result.operations) / result.seconds;
+        for (auto percentile: PERCENTILES)
+        {
+            stream << ',';
+            if (result.latency.count > 0)
+            {
+                stream << result.latency.percentile(percentile);
+            }
+        }
+        stream << ',';
+        if (result.latency.count > 0)
+        {
+            stream << result.latency.max;
+        }
+        stream << '\n';
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void
+bench_write_json(std::ostream &stream, const BenchResults &results)
+{
+    stream << "[\n";
+
+    const char *separator = "";
+    for (auto &result: results)
+    {
+        stream << separator
+               << "  {\"suite\":\"" << result.suite << "\""
+               << ",\"name\":\"" << result.name << "\""
+               << ",\"threads\":" << result.threads
+               << ",\"operations\":" << result.operations
+               << ",\"seconds\":" << result.seconds
+               << ",\"ops_per_second\":"
+               << double(result.operations) / result.seconds;
+        if (result.latency.count > 0)
+        {
+            stream << ",\"latency_ns\":{";
+            for (auto percentile: PERCENTILES)
+            {
+                stream << "\"p" << percentile << "\":"
+                       << result.latency.percentile(percentile) << ',';
+            }
+            stream << "\"max\":" << result.latency.max << '}';
+        }
+        stream << '}';
+        separator = ",\n";
+    }
+
+    stream << "\n]\n";
+}
+
+// -----------------------------------------------------------------------------
+
+int
+main(int argc, char *argv[])
+{
+    std::string suite = "all";
+    std::string format = "csv";
+
+    BenchConfig config;
+    config.max_threads = std::size_t(::sysconf(_SC_NPROCESSORS_ONLN));
+    config.operations = 100000;
+    config.seconds = 1.0;
+    config.rate = 1000.0;
+    config.poisson = true;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string value;
+        if (parse_option(argv[i], "--suite", value))
+        {
+            suite = value;
+        }
+        else if (parse_option(argv[i], "--threads", value))
+        {
+            config.max_threads = std::strtoul(value.c_str(), nullptr, 10);
+        }
+        else if (parse_option(argv[i], "--operations", value))
+        {
+            config.operations = std::strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (parse_option(argv[i], "--duration", value))
+        {
+            config.seconds = std::strtod(value.c_str(), nullptr);
+        }
+        else if (parse_option(argv[i], "--rate", value))
+        {
+            config.rate = std::strtod(value.c_str(), nullptr);
+        }
+        else if (parse_option(argv[i], "--arrivals", value)
+                 && (value == "poisson" || value == "constant"))
+        {
+            config.poisson = (value == "poisson");
+        }
+        else if (parse_option(argv[i], "--format", value)
+                 && (value == "csv" || value == "json"))
+        {
+            format = value;
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (config.max_threads < 1)
+    {
+        config.max_threads = 1;
+    }
+
+    if (config.seconds <= 0.0 || config.rate <= 0.0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    BenchResults results;
+    bool found = false;
+
+    if (suite == "all" || suite == "queue")
+    {
+        bench_queue(config, results);
+        found = true;
+    }
+
+    if (suite == "all" || suite == "latency")
+    {
+        bench_latency(config, results);
+        found = true;
+    }
+
+    if (suite == "all" || suite == "empty")
+    {
+        bench_empty(config, results);
+        found = true;
+    }
+
+    if (suite == "all" || suite == "scaling")
+    {
+        bench_scaling(config, results);
+        found = true;
+    }
+
+    if (suite == "all" || suite == "openloop")
+    {
+        bench_openloop(config, results);
+        found = true;
+    }
+
+    if (suite == "all" || suite == "jitter")
+    {
+        bench_jitter(config, results);
+        found = true;
+    }
+
+    if (!found)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (format == "json")
+    {
+        bench_write_json(std::cout, results);
+    }
+    else
+    {
+        bench_write_csv(std::cout, results);
+    }
+
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
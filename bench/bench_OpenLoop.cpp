@@ -0,0 +1,218 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "bench_Utils.h"
+
+#include "Clock.h"
+#include "Thread.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include <sched.h>
+
+// -----------------------------------------------------------------------------
+
+namespace {
+
+// About 10 microseconds of work:
+const std::uint64_t ITERATIONS = 5000;
+
+// The load is doubled at most this number of times:
+const int MAX_STEPS = 20;
+
+// The pool is saturated when it completes less than this fraction of the
+// offered load:
+const double SATURATION = 0.95;
+
+class OpenLoopTask
+        :
+                public WorkTask
+{
+
+public:
+
+    std::uint64_t m_intended_ns;
+    std::uint64_t m_finish_ns;
+
+    explicit OpenLoopTask(std::uint64_t intended_ns)
+            :
+            WorkTask(ITERATIONS),
+            m_intended_ns(intended_ns),
+            m_finish_ns(0)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        WorkTask::execute();
+        m_finish_ns = clock_now_ns();
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+// Collects the completed tasks while the load is being generated:
+class CollectorTask
+        :
+                public ITask
+{
+
+    IThreadPool &m_pool;
+    std::size_t m_count;
+    Histogram &m_latency;
+    std::uint64_t &m_last_finish_ns;
+
+public:
+
+    CollectorTask(IThreadPool &pool,
+                  std::size_t count,
+                  Histogram &latency,
+                  std::uint64_t &last_finish_ns)
+            :
+            m_pool(pool),
+            m_count(count),
+            m_latency(latency),
+            m_last_finish_ns(last_finish_ns)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        std::shared_ptr<OpenLoopTask> task;
+        for (std::size_t i = 0; i < m_count; ++i)
+        {
+            // Nothing more to collect once the pool is shut down:
+            if (0 == m_pool.popT(task, true))
+            {
+                break;
+            }
+
+            // Measured from the intended start, not from the actual push,
+            // so that a late generator doesn't hide the queueing delay:
+            m_latency.record(task->m_finish_ns - task->m_intended_ns);
+            if (task->m_finish_ns > m_last_finish_ns)
+            {
+                m_last_finish_ns = task->m_finish_ns;
+            }
+        }
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+// Offsets (nanoseconds from the beginning of the step) of the arrivals:
+void
+schedule(const BenchConfig &config,
+         double rate,
+         std::default_random_engine &engine,
+         std::vector<std::uint64_t> &offsets)
+{
+    const double duration_ns = config.seconds * 1e9;
+    std::exponential_distribution<double> poisson_gap(rate / 1e9);
+    const double constant_gap = 1e9 / rate;
+
+    offsets.clear();
+    for (double time = 0.0; time < duration_ns;)
+    {
+        offsets.push_back(std::uint64_t(time));
+        time += config.poisson ? poisson_gap(engine) : constant_gap;
+    }
+}
+
+} // anonymous namespace
+
+// -----------------------------------------------------------------------------
+
+/**
+ * Open-loop load: tasks are issued at their scheduled time whatever the
+ * backlog of the pool, and their latency is measured from the scheduled
+ * time (free from coordinated omission). The rate is doubled at each step
+ * until the pool cannot keep up any more.
+ */
+void
+bench_openloop(const BenchConfig &config, BenchResults &results)
+{
+    std::default_random_engine engine;
+    std::vector<std::uint64_t> offsets;
+
+    double rate = config.rate;
+    for (int step = 0; step < MAX_STEPS; ++step, rate *= 2.0)
+    {
+        schedule(config, rate, engine, offsets);
+
+        std::unique_ptr<IThreadPool> pool(
+                IThreadPool::create(config.max_threads));
+        Histogram latency;
+        std::uint64_t last_finish = 0;
+
+        Thread collector = IThread::create(std::make_shared<CollectorTask>(
+                *pool, offsets.size(), latency, last_finish));
+
+        std::uint64_t begin = clock_now_ns();
+        for (auto offset: offsets)
+        {
+            std::uint64_t intended = begin + offset;
+            while (clock_now_ns() < intended)
+            {
+                ::sched_yield();
+            }
+
+            pool->push(std::make_shared<OpenLoopTask>(intended));
+        }
+
+        collector->join();
+        pool->join();
+
+        std::stringstream name;
+        name << (config.poisson ? "poisson@" : "constant@") << rate;
+
+        BenchResult result("openloop", name.str(), config.max_threads);
+        result.operations = offsets.size();
+        result.seconds = bench_seconds(begin, std::max(last_finish, begin + 1));
+        latency.snapshot(result.latency);
+        results.push_back(result);
+
+        double achieved = double(result.operations) / result.seconds;
+        if (achieved < SATURATION * rate)
+        {
+            break;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
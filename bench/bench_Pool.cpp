@@ -0,0 +1,204 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "bench_Utils.h"
+
+#include "Clock.h"
+#include "ThreadPool.h"
+
+#include <memory>
+#include <vector>
+
+#include <unistd.h>
+
+// -----------------------------------------------------------------------------
+
+namespace {
+
+class EmptyTask
+        :
+                public ITask
+{
+
+public:
+
+    virtual void
+    execute()
+    {
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+// Pushes all the tasks (retrying while the pool is full) and then collects
+// them, returns the elapsed wall time:
+double
+run_batch(IThreadPool &pool, std::vector<Task> &tasks)
+{
+    std::uint64_t begin = clock_now_ns();
+
+    for (auto &task: tasks)
+    {
+        pool.push(task);
+    }
+
+    Task task;
+    for (std::size_t i = 0; i < tasks.size(); ++i)
+    {
+        pool.pop(task, true);
+    }
+
+    return bench_seconds(begin, clock_now_ns());
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+ * Submit-to-complete latency of one task at a time on one pool.
+ */
+void
+bench_latency_run(const BenchConfig &config,
+                  std::size_t threads,
+                  const WaitStrategy &wait_strategy,
+                  const char *name,
+                  BenchResults &results)
+{
+    ThreadPoolOptions options(threads);
+    options.wait_strategy = wait_strategy;
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(options));
+    Task task = std::make_shared<EmptyTask>();
+    Histogram latency;
+
+    std::uint64_t begin = clock_now_ns();
+    for (std::uint64_t i = 0; i < config.operations; ++i)
+    {
+        std::uint64_t submitted = clock_now_ns();
+        pool->push(task);
+        pool->pop(task, true);
+        latency.record(clock_now_ns() - submitted);
+    }
+    std::uint64_t end = clock_now_ns();
+
+    BenchResult result("latency", name, threads);
+    result.operations = config.operations;
+    result.seconds = bench_seconds(begin, end);
+    latency.snapshot(result.latency);
+    results.push_back(result);
+
+    pool->join();
+}
+
+} // anonymous namespace
+
+// -----------------------------------------------------------------------------
+
+/**
+ * Submit-to-complete latency of one task at a time, with parking workers
+ * and with polling ones.
+ */
+void
+bench_latency(const BenchConfig &config, BenchResults &results)
+{
+    const std::size_t cpus = std::size_t(::sysconf(_SC_NPROCESSORS_ONLN));
+
+    for (auto threads: bench_thread_counts(config.max_threads))
+    {
+        bench_latency_run(config, threads, WaitStrategy(),
+                          "submit_to_complete", results);
+
+        // Polling pays off only with a processor for each polling thread
+        // and one for the caller:
+        if (threads < cpus)
+        {
+            bench_latency_run(config, threads, WaitStrategy(100, 10000, 100),
+                              "submit_to_complete_polling", results);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+ * Throughput of tasks doing nothing, that is the overhead of the pool.
+ */
+void
+bench_empty(const BenchConfig &config, BenchResults &results)
+{
+    std::vector<Task> tasks;
+    for (std::uint64_t i = 0; i < config.operations; ++i)
+    {
+        tasks.push_back(std::make_shared<EmptyTask>());
+    }
+
+    for (auto threads: bench_thread_counts(config.max_threads))
+    {
+        std::unique_ptr<IThreadPool> pool(IThreadPool::create(threads));
+
+        BenchResult result("empty", "empty_task", threads);
+        result.operations = tasks.size();
+        result.seconds = run_batch(*pool, tasks);
+        results.push_back(result);
+
+        pool->join();
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+ * Throughput of CPU bound tasks (about a few microseconds each) from one
+ * thread up to the greatest number of threads.
+ */
+void
+bench_scaling(const BenchConfig &config, BenchResults &results)
+{
+    const std::uint64_t NUM_TASKS = config.operations / 10 + 1;
+    const std::uint64_t ITERATIONS = 5000;
+
+    std::vector<Task> tasks;
+    for (std::uint64_t i = 0; i < NUM_TASKS; ++i)
+    {
+        tasks.push_back(std::make_shared<WorkTask>(ITERATIONS));
+    }
+
+    for (std::size_t threads = 1; threads <= config.max_threads; ++threads)
+    {
+        std::unique_ptr<IThreadPool> pool(IThreadPool::create(threads));
+
+        BenchResult result("scaling", "work_task", threads);
+        result.operations = tasks.size();
+        result.seconds = run_batch(*pool, tasks);
+        results.push_back(result);
+
+        pool->join();
+    }
+}
+
+// -----------------------------------------------------------------------------
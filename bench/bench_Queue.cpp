@@ -0,0 +1,188 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "bench_Utils.h"
+
+#include "Clock.h"
+#include "MessageQueue.h"
+#include "SpscQueue.h"
+#include "Thread.h"
+
+#include <atomic>
+#include <sstream>
+#include <vector>
+
+#include <sched.h>
+
+// -----------------------------------------------------------------------------
+
+namespace {
+
+const std::size_t QUEUE_CAPACITY = 1024;
+
+template<typename Queue>
+class ProducerTask
+        :
+                public ITask
+{
+
+    Queue &m_queue;
+    const std::atomic<bool> &m_start;
+    std::uint64_t m_count;
+
+public:
+
+    ProducerTask(Queue &queue,
+                 const std::atomic<bool> &start,
+                 std::uint64_t count)
+            :
+            m_queue(queue),
+            m_start(start),
+            m_count(count)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        while (!m_start.load(std::memory_order_acquire))
+        {
+            ::sched_yield();
+        }
+
+        for (std::uint64_t i = 0; i < m_count; ++i)
+        {
+            while (0 == m_queue.push(i))
+            {
+                ::sched_yield();
+            }
+        }
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+template<typename Queue>
+class ConsumerTask
+        :
+                public ITask
+{
+
+    Queue &m_queue;
+    std::uint64_t m_count;
+
+public:
+
+    ConsumerTask(Queue &queue,
+                 std::uint64_t count)
+            :
+            m_queue(queue),
+            m_count(count)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        std::uint64_t message;
+        for (std::uint64_t i = 0; i < m_count; ++i)
+        {
+            m_queue.pop(message, true);
+        }
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+template<typename Queue>
+double
+run_queue(Queue &queue, std::size_t threads, std::uint64_t per_thread)
+{
+    std::atomic<bool> start(false);
+    std::vector<Thread> workers;
+
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+        workers.push_back(IThread::create(
+                std::make_shared<ConsumerTask<Queue> >(queue, per_thread)));
+        workers.push_back(IThread::create(
+                std::make_shared<ProducerTask<Queue> >(queue, start,
+                                                       per_thread)));
+    }
+
+    std::uint64_t begin = clock_now_ns();
+    start.store(true, std::memory_order_release);
+    for (auto &worker: workers)
+    {
+        worker->join();
+    }
+    std::uint64_t end = clock_now_ns();
+
+    return bench_seconds(begin, end);
+}
+
+} // anonymous namespace
+
+// -----------------------------------------------------------------------------
+
+/**
+ * Push/pop throughput of a bounded queue shared by as many producers as
+ * consumers, and of the SPSC queue with one producer and one consumer.
+ */
+void
+bench_queue(const BenchConfig &config, BenchResults &results)
+{
+    for (auto threads: bench_thread_counts(config.max_threads))
+    {
+        const std::uint64_t per_thread = config.operations / threads;
+
+        MessageQueueT<std::uint64_t> queue(QUEUE_CAPACITY);
+        double seconds = run_queue(queue, threads, per_thread);
+
+        std::stringstream name;
+        name << threads << "p" << threads << "c";
+
+        BenchResult result("queue", name.str(), threads * 2);
+        result.operations = per_thread * threads;
+        result.seconds = seconds;
+        results.push_back(result);
+    }
+
+    // The same one-to-one pipeline through the lock-free SPSC queue:
+    SpscQueueT<std::uint64_t> queue(QUEUE_CAPACITY);
+
+    BenchResult result("queue", "1p1c-spsc", 2);
+    result.operations = config.operations;
+    result.seconds = run_queue(queue, 1, config.operations);
+    results.push_back(result);
+}
+
+// -----------------------------------------------------------------------------
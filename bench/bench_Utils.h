@@ -0,0 +1,160 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BENCH_UTILS_H
+#define BENCH_UTILS_H
+
+#include "Histogram.h"
+#include "Task.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Outcome of one benchmark run.
+ */
+struct BenchResult
+{
+    std::string suite;          ///< Name of the suite.
+    std::string name;           ///< Name of the run inside the suite.
+    std::size_t threads;        ///< Number of threads used by the run.
+    std::uint64_t operations;   ///< Number of measured operations.
+    double seconds;             ///< Wall time of the run.
+    HistogramSnapshot latency;  ///< Optional latencies (nanoseconds).
+
+    BenchResult(const std::string &suite,
+                const std::string &name,
+                std::size_t threads)
+            : suite(suite),
+              name(name),
+              threads(threads),
+              operations(0),
+              seconds(0.0)
+    {
+    }
+};
+
+/**
+ * @brief Parameters shared by all the suites.
+ */
+struct BenchConfig
+{
+    std::size_t max_threads;    ///< Greatest number of threads to use.
+    std::uint64_t operations;   ///< Number of operations for each run.
+    double seconds;             ///< Duration of time-bounded runs.
+    double rate;                ///< Initial rate (tasks/s) of open-loop runs.
+    bool poisson;               ///< Poisson (or constant) open-loop arrivals.
+};
+
+typedef std::vector<BenchResult> BenchResults;
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief CPU bound task, each iteration takes a few nanoseconds.
+ */
+class WorkTask
+        :
+                public ITask
+{
+
+    std::uint64_t m_iterations;
+    volatile std::uint64_t m_result;
+
+public:
+
+    explicit WorkTask(std::uint64_t iterations)
+            :
+            m_iterations(iterations),
+            m_result(0)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        std::uint64_t value = 0;
+        for (std::uint64_t i = 0; i < m_iterations; ++i)
+        {
+            value = value * 6364136223846793005ull + 1442695040888963407ull;
+        }
+        m_result = value;
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Returns the powers of two lower than @a max_threads, followed by
+ * @a max_threads itself.
+ */
+inline std::vector<std::size_t>
+bench_thread_counts(std::size_t max_threads)
+{
+    std::vector<std::size_t> ret;
+    for (std::size_t threads = 1; threads < max_threads; threads *= 2)
+    {
+        ret.push_back(threads);
+    }
+    ret.push_back(max_threads);
+
+    return ret;
+}
+
+/**
+ * @brief Returns the elapsed seconds between two values of @ref
+ * clock_now_ns.
+ */
+inline double
+bench_seconds(std::uint64_t begin_ns, std::uint64_t end_ns)
+{
+    return double(end_ns - begin_ns) / 1e9;
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Writes the results as CSV, one line per run.
+ */
+void bench_write_csv(std::ostream &stream, const BenchResults &results);
+
+/**
+ * @brief Writes the results as a JSON array, one object per run.
+ */
+void bench_write_json(std::ostream &stream, const BenchResults &results);
+
+// -----------------------------------------------------------------------------
+
+#endif // BENCH_UTILS_H
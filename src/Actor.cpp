@@ -0,0 +1,227 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Actor.h"
+
+#include <exception>
+
+#include <sched.h>
+
+// -----------------------------------------------------------------------------
+
+class ActorTask
+        :
+                public ITask
+{
+
+    Actor &m_actor;
+
+public:
+
+    explicit ActorTask(Actor &actor)
+            : m_actor(actor)
+    {
+    }
+
+    virtual
+    ~ActorTask()
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        m_actor.run();
+    }
+
+    // Cancelled along with the pool, nothing is going to run the actor:
+    virtual void
+    cancel()
+    {
+        m_actor.abandon();
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+const std::size_t Actor::DEFAULT_BATCH;
+
+// -----------------------------------------------------------------------------
+
+Actor::Actor(IThreadPool &pool, std::size_t batch)
+        :
+        m_pool(pool),
+        m_batch(batch > 0 ? batch : 1),
+        m_pending(0)
+{
+}
+
+// -----------------------------------------------------------------------------
+
+Actor::~Actor()
+{
+}
+
+// -----------------------------------------------------------------------------
+
+void
+Actor::send(MailboxMessage message)
+{
+    m_mailbox.push(message);
+
+    if (0 == m_pending.fetch_add(1, std::memory_order_acq_rel))
+    {
+        schedule();
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+std::size_t
+Actor::pending() const
+{
+    return m_pending.load(std::memory_order_acquire);
+}
+
+// -----------------------------------------------------------------------------
+
+void
+Actor::schedule()
+{
+    // A new task each time: the worker still owns the previous one while the
+    // actor reschedules itself.
+    Task task(new ActorTask(*this));
+    task->m_internal = true;
+    while (0 == m_pool.post(task))
+    {
+        if (m_pool.is_closed())
+        {
+            abandon();
+            return;
+        }
+
+        ::sched_yield();
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void
+Actor::abandon()
+{
+    // Owns the actor like run() does, until no message is left:
+    std::size_t discarded;
+    do
+    {
+        discarded = 0;
+        MailboxMessage message;
+        while (discarded < m_pending.load(std::memory_order_acquire))
+        {
+            // The counted message may still be linked by its sender:
+            if (!m_mailbox.pop(message))
+            {
+                ::sched_yield();
+                continue;
+            }
+
+            discard(message);
+            message.reset();
+            ++discarded;
+        }
+    }
+    while (m_pending.fetch_sub(discarded, std::memory_order_acq_rel)
+           > discarded);
+}
+
+// -----------------------------------------------------------------------------
+
+void
+Actor::discard(MailboxMessage message)
+{
+    (void) message;
+}
+
+// -----------------------------------------------------------------------------
+
+void
+Actor::run()
+{
+    std::size_t processed = 0;
+    MailboxMessage message;
+    std::exception_ptr exception;
+
+    while (processed < m_batch)
+    {
+        if (!m_mailbox.pop(message))
+        {
+            // Every counted message is in the mailbox or is being linked by
+            // its sender:
+            if (processed < m_pending.load(std::memory_order_acquire))
+            {
+                ::sched_yield();
+                continue;
+            }
+
+            break;
+        }
+
+        // A failing message must not leave the actor scheduled forever:
+        try
+        {
+            receive(message);
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+        }
+
+        message.reset();
+        ++processed;
+
+        if (exception)
+        {
+            break;
+        }
+    }
+
+    // Still owns the pool if more messages arrived in the meanwhile:
+    if (m_pending.fetch_sub(processed, std::memory_order_acq_rel) > processed)
+    {
+        schedule();
+    }
+
+    // Reported by the worker of the pool:
+    if (exception)
+    {
+        std::rethrow_exception(exception);
+    }
+}
+
+// -----------------------------------------------------------------------------
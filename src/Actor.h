@@ -0,0 +1,172 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef ACTOR_H
+#define ACTOR_H
+
+#include "Mailbox.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief Object that processes its messages one at a time on the threads of
+ * a pool.
+ *
+ * Every actor owns a @ref Mailbox; the actor is posted to the pool (see
+ * method @ref IThreadPool::post) only when a message arrives into an empty
+ * mailbox and it stays on the pool until the mailbox is empty again, so an
+ * idle actor costs no thread and no system resource and any number of
+ * actors can share the few threads of one pool.
+ *
+ * The messages of one actor are processed in the order they have been sent
+ * and never concurrently with each other, so the state of the actor doesn't
+ * need any synchronization.
+ *
+ * Example:
+ * @code
+   class Counter: public Actor
+   {
+       int m_count;
+
+   public:
+
+       Counter(IThreadPool &pool): Actor(pool), m_count(0) {}
+
+   protected:
+
+       virtual void receive(MailboxMessage message) { ++m_count; }
+   };
+ * @endcode
+ *
+ * @note
+ * - Method @ref send is thread safe.
+ * - The pool should be created with an unbounded task capacity: when the
+ *   pool is full the actor keeps retrying to post itself.
+ * - Once the pool is shut down (see method @ref IThreadPool::shutdown) the
+ *   messages left into the mailbox are discarded (see method @ref
+ *   discard).
+ * - The actor must outlive the processing of its messages: join the pool
+ *   (or wait for method @ref pending to return @a zero) before destroying
+ *   it.
+ *
+ * @ingroup threading-high
+ */
+class Actor
+{
+
+public:
+
+    /**
+     * @brief Default number of messages processed before giving the thread
+     * back to the pool.
+     */
+    static const std::size_t DEFAULT_BATCH = 64;
+
+    /**
+     * @brief Constructor.
+     *
+     * @param pool The thread pool executing the actor.
+     *
+     * @param batch Maximum number of messages processed before giving the
+     *        thread back to the pool, to be fair with the other actors.
+     */
+    explicit Actor(IThreadPool &pool, std::size_t batch = DEFAULT_BATCH);
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~Actor();
+
+    /**
+     * @brief Sends one message to the actor.
+     *
+     * @param message The message to be processed by @ref receive.
+     *
+     * @pre
+     * - The parameter message is not null and not queued into any mailbox.
+     */
+    void send(MailboxMessage message);
+
+    /**
+     * @brief Returns the number of messages sent but not yet processed.
+     */
+    std::size_t pending() const;
+
+protected:
+
+    /**
+     * @brief Processes one message.
+     *
+     * Called by the threads of the pool, never concurrently for the same
+     * actor. An exception thrown by the method ends the current batch and
+     * is counted by the pool (see @ref ThreadPoolStats::failed), the next
+     * messages are processed anyway.
+     */
+    virtual void receive(MailboxMessage message) = 0;
+
+    /**
+     * @brief Drops one message that is not going to be processed because
+     * the pool have been shut down.
+     *
+     * Called at most once for each message, never concurrently with @ref
+     * receive. Does nothing by default.
+     */
+    virtual void discard(MailboxMessage message);
+
+private:
+
+    Actor(const Actor &);
+    Actor &operator=(const Actor &);
+
+    friend class ActorTask;
+
+    void schedule();
+
+    void run();
+
+    void abandon();
+
+    IThreadPool &m_pool;
+    std::size_t m_batch;
+    Mailbox m_mailbox;
+
+    // Messages sent but not processed yet, the actor is posted to the pool
+    // by whoever moves it away from zero:
+    std::atomic<std::size_t> m_pending;
+
+};
+
+// ----------------------------------------------------------------------------
+
+#endif // ACTOR_H
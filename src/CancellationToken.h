@@ -0,0 +1,108 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CANCELLATIONTOKEN_H
+#define CANCELLATIONTOKEN_H
+
+#include <atomic>
+#include <memory>
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief Shared flag to cancel a group of tasks at once.
+ *
+ * A token is attached to any number of tasks (see @ref
+ * ITask::set_cancellation_token); once it is cancelled the tasks not yet
+ * started are skipped by the thread pool without being executed, while the
+ * running ones can stop early by polling @ref ITask::is_cancelled.
+ *
+ * Copies of a token share the same flag.
+ *
+ * Example:
+ * @code
+   CancellationToken token;
+   for (auto &request: client_requests)
+   {
+       auto task = std::make_shared<RequestTask>(request);
+       task->set_cancellation_token(token);
+       pool->push(task);
+   }
+   ...
+   token.cancel(); // The client disconnected.
+ * @endcode
+ *
+ * @note The class is thread safe.
+ *
+ * @ingroup threading-high
+ */
+class CancellationToken
+{
+
+public:
+
+    /**
+     * @brief Constructor, creates a new flag not cancelled.
+     */
+    CancellationToken()
+            : m_flag(std::make_shared<std::atomic<bool> >(false))
+    {
+    }
+
+    /**
+     * @brief Cancels the token and all the tasks it is attached to.
+     *
+     * The cancelled status is not reversible.
+     */
+    void
+    cancel()
+    {
+        m_flag->store(true, std::memory_order_release);
+    }
+
+    /**
+     * @brief Returns @a true if the token have been cancelled.
+     */
+    bool
+    is_cancelled() const
+    {
+        return m_flag->load(std::memory_order_acquire);
+    }
+
+private:
+
+    friend class ITask;
+
+    std::shared_ptr<std::atomic<bool> > m_flag;
+
+};
+
+// ----------------------------------------------------------------------------
+
+#endif // CANCELLATIONTOKEN_H
@@ -0,0 +1,156 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef EVENTCOUNT_H
+#define EVENTCOUNT_H
+
+#include "Cond.h"
+#include "Mutex.h"
+
+#include <atomic>
+#include <cstdint>
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief Condition variable for lock-free data structures.
+ *
+ * An event count lets a thread wait for a condition that is checked without
+ * any lock, with the following protocol:
+ *
+ * @code
+   for (;;)
+   {
+       if (condition()) break;
+       auto key = event_count.prepare_wait();
+       if (condition()) { event_count.cancel_wait(); break; }
+       event_count.wait(key);
+   }
+ * @endcode
+ *
+ * while the threads changing the condition call @ref notify afterwards. A
+ * notification happening after @ref prepare_wait is never lost, and
+ * @ref notify takes the mutex only when some thread is actually waiting.
+ *
+ * @ingroup threading-base
+ */
+class EventCount
+{
+
+public:
+
+    /**
+     * @brief Identifies the notifications already seen by a waiter.
+     */
+    typedef std::uint64_t Key;
+
+    /**
+     * @brief Constructor.
+     */
+    EventCount()
+            : m_epoch(0),
+              m_waiters(0),
+              m_mutex("EventCount")
+    {
+    }
+
+    /**
+     * @brief Announces the intention to wait, to be called before the last
+     * check of the condition.
+     *
+     * @return The key to be passed to @ref wait.
+     */
+    Key
+    prepare_wait()
+    {
+        m_waiters.fetch_add(1);
+        return m_epoch.load();
+    }
+
+    /**
+     * @brief Withdraws the intention to wait announced by @ref prepare_wait,
+     * to be called when the condition turned out to be already satisfied.
+     */
+    void
+    cancel_wait()
+    {
+        m_waiters.fetch_sub(1);
+    }
+
+    /**
+     * @brief Blocks the calling thread until @ref notify is called after the
+     * call to @ref prepare_wait that returned the key.
+     *
+     * @param key The value returned by @ref prepare_wait.
+     */
+    void
+    wait(Key key)
+    {
+        {
+            Locker locker(m_mutex);
+            while (m_epoch.load() == key)
+            {
+                m_cond.wait(m_mutex);
+            }
+        }
+
+        m_waiters.fetch_sub(1);
+    }
+
+    /**
+     * @brief Wakes up all the waiting threads.
+     */
+    void
+    notify()
+    {
+        m_epoch.fetch_add(1);
+        if (m_waiters.load() > 0)
+        {
+            Locker locker(m_mutex);
+            m_cond.broadcast();
+        }
+    }
+
+private:
+
+    typedef ::Locker<Mutex> Locker;
+
+    EventCount(const EventCount &);
+    EventCount &operator=(const EventCount &);
+
+    std::atomic<Key> m_epoch;
+    std::atomic<std::uint32_t> m_waiters;
+    Mutex m_mutex;
+    Cond m_cond;
+
+};
+
+// ----------------------------------------------------------------------------
+
+#endif // EVENTCOUNT_H
@@ -0,0 +1,118 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "EventFd.h"
+
+#include <cstdint>
+
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+// -----------------------------------------------------------------------------
+
+EventFd::EventFd()
+        :
+        m_signalled(false)
+{
+#if defined(__linux__)
+    m_fds[0] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_fds[1] = m_fds[0];
+#else
+    int ret = ::pipe(m_fds);
+    assert(0 == ret);
+    (void) ret;
+
+    for (int i = 0; i < 2; ++i)
+    {
+        ::fcntl(m_fds[i], F_SETFL, ::fcntl(m_fds[i], F_GETFL) | O_NONBLOCK);
+        ::fcntl(m_fds[i], F_SETFD, FD_CLOEXEC);
+    }
+#endif
+
+    assert(m_fds[0] >= 0);
+}
+
+// -----------------------------------------------------------------------------
+
+EventFd::~EventFd()
+{
+    ::close(m_fds[0]);
+    if (m_fds[1] != m_fds[0])
+    {
+        ::close(m_fds[1]);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+int
+EventFd::fd() const
+{
+    return m_fds[0];
+}
+
+// -----------------------------------------------------------------------------
+
+void
+EventFd::signal()
+{
+    if (m_signalled.load(std::memory_order_relaxed)
+        || m_signalled.exchange(true))
+    {
+        return;
+    }
+
+    // An eventfd needs exactly 8 bytes, a pipe is happy with them too:
+    std::uint64_t value = 1;
+    ssize_t ret = ::write(m_fds[1], &value, sizeof(value));
+    (void) ret;
+}
+
+// -----------------------------------------------------------------------------
+
+void
+EventFd::clear()
+{
+    std::uint64_t value;
+    while (::read(m_fds[0], &value, sizeof(value)) > 0)
+    {
+    }
+
+    // Cleared after the read: a signal racing with the read either finds
+    // the flag still set and its event is consumed after this call, or
+    // writes again. At worst the descriptor is left spuriously readable.
+    m_signalled.store(false);
+}
+
+// -----------------------------------------------------------------------------
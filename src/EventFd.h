@@ -0,0 +1,103 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef EVENTFD_H
+#define EVENTFD_H
+
+#include <atomic>
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief File descriptor that becomes readable when signalled, to plug
+ * in-process events into @a poll, @a epoll or @a select loops.
+ *
+ * Uses an @a eventfd on Linux and a non blocking pipe on the other Posix
+ * platforms. Signals are coalesced: between two calls to @ref clear only the
+ * first call to @ref signal performs a system call, the others just find the
+ * descriptor already readable.
+ *
+ * @note Methods @ref signal and @ref clear can be called concurrently by any
+ * thread.
+ *
+ * @ingroup threading-base
+ */
+class EventFd
+{
+
+public:
+
+    /**
+     * @brief Constructor, creates the non readable file descriptor.
+     */
+    EventFd();
+
+    /**
+     * @brief Destructor, closes the file descriptor.
+     */
+    ~EventFd();
+
+    /**
+     * @brief Returns the file descriptor to be watched for readability.
+     *
+     * The descriptor is owned by the object: it must not be read or closed
+     * by the user.
+     */
+    int fd() const;
+
+    /**
+     * @brief Makes the file descriptor readable, unless it is already.
+     */
+    void signal();
+
+    /**
+     * @brief Makes the file descriptor non readable.
+     *
+     * To be called once the descriptor is reported readable, @b before
+     * consuming the events it signals, so that an event happening while
+     * they are consumed signals the descriptor again.
+     */
+    void clear();
+
+private:
+
+    EventFd(const EventFd &);
+    EventFd &operator=(const EventFd &);
+
+    // Read end and write end (the same descriptor for an eventfd):
+    int m_fds[2];
+
+    // Set by the first signal after a clear:
+    std::atomic<bool> m_signalled;
+
+};
+
+// ----------------------------------------------------------------------------
+
+#endif // EVENTFD_H
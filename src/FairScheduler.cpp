@@ -0,0 +1,361 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "FairScheduler.h"
+#include "Clock.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <sched.h>
+
+// -----------------------------------------------------------------------------
+
+class FairSchedulerTask
+        :
+                public ITask
+{
+
+    FairScheduler &m_scheduler;
+
+public:
+
+    explicit FairSchedulerTask(FairScheduler &scheduler)
+            : m_scheduler(scheduler)
+    {
+    }
+
+    virtual
+    ~FairSchedulerTask()
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        m_scheduler.run();
+    }
+
+    // Cancelled along with the pool, gives its place back:
+    virtual void
+    cancel()
+    {
+        m_scheduler.abandon();
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+const std::uint64_t FairScheduler::DEFAULT_QUANTUM_NS;
+const std::size_t FairScheduler::DEFAULT_BATCH;
+
+// -----------------------------------------------------------------------------
+
+FairScheduler::FairScheduler(IThreadPool &pool,
+                             std::size_t concurrency,
+                             std::uint64_t quantum_ns,
+                             std::size_t batch)
+        :
+        m_pool(pool),
+        m_concurrency(concurrency > 0 ? concurrency : 1),
+        m_quantum_ns(quantum_ns > 0 ? quantum_ns : 1),
+        m_batch(batch > 0 ? batch : 1),
+        m_mutex("FairScheduler"),
+        m_cursor(0),
+        m_pending(0),
+        m_active(0)
+{
+}
+
+// -----------------------------------------------------------------------------
+
+FairScheduler::~FairScheduler()
+{
+}
+
+// -----------------------------------------------------------------------------
+
+FairScheduler::Group
+FairScheduler::add_group(std::size_t weight, std::size_t max_concurrency)
+{
+    assert(weight > 0);
+
+    std::unique_ptr<GroupState> group(new GroupState());
+    group->m_quantum_ns = weight * m_quantum_ns;
+    group->m_max_concurrency = max_concurrency;
+    group->m_running = 0;
+    group->m_deficit_ns = 0;
+    group->m_executed = 0;
+    group->m_busy_ns = 0;
+
+    Locker locker(m_mutex);
+    m_groups.push_back(std::move(group));
+
+    return m_groups.size() - 1;
+}
+
+// -----------------------------------------------------------------------------
+
+void
+FairScheduler::post(Group group, Task task)
+{
+    assert(nullptr != task.get());
+
+    bool start = false;
+    {
+        Locker locker(m_mutex);
+        assert(group < m_groups.size());
+
+        GroupState &state = *m_groups[group];
+        state.m_tasks.push_back(task);
+        ++m_pending;
+
+        if (m_active < m_concurrency && is_eligible(state))
+        {
+            ++m_active;
+            start = true;
+        }
+    }
+
+    if (start)
+    {
+        schedule();
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+std::size_t
+FairScheduler::pending() const
+{
+    Locker locker(m_mutex);
+    return m_pending;
+}
+
+// -----------------------------------------------------------------------------
+
+void
+FairScheduler::stats(Group group, FairSchedulerGroupStats &dst) const
+{
+    Locker locker(m_mutex);
+    assert(group < m_groups.size());
+
+    const GroupState &state = *m_groups[group];
+    dst.pending = state.m_tasks.size();
+    dst.running = state.m_running;
+    dst.executed = state.m_executed;
+    dst.busy_ns = state.m_busy_ns;
+}
+
+// -----------------------------------------------------------------------------
+
+void
+FairScheduler::schedule()
+{
+    // A new task each time: the worker still owns the previous one while the
+    // scheduler reschedules itself.
+    Task task(new FairSchedulerTask(*this));
+    task->m_internal = true;
+    while (0 == m_pool.post(task))
+    {
+        if (m_pool.is_closed())
+        {
+            abandon();
+            return;
+        }
+
+        ::sched_yield();
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void
+FairScheduler::abandon()
+{
+    std::deque<Task> tasks;
+    {
+        Locker locker(m_mutex);
+        assert(m_active > 0);
+        --m_active;
+
+        // The pool is closed, the last task of the scheduler cancels the
+        // queued ones:
+        if (0 == m_active)
+        {
+            for (auto &group: m_groups)
+            {
+                tasks.insert(tasks.end(),
+                             group->m_tasks.begin(),
+                             group->m_tasks.end());
+                group->m_tasks.clear();
+            }
+            m_pending = 0;
+        }
+    }
+
+    for (auto &task: tasks)
+    {
+        ITask::run_cancel(*task);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void
+FairScheduler::run()
+{
+    std::size_t processed = 0;
+    GroupState *group = nullptr;
+    std::uint64_t elapsed = 0;
+    Task task;
+
+    for (;;)
+    {
+        {
+            Locker locker(m_mutex);
+
+            // Charges the group of the previous task:
+            if (nullptr != group)
+            {
+                group->m_deficit_ns -= std::int64_t(elapsed);
+                group->m_busy_ns += elapsed;
+                group->m_executed++;
+                group->m_running--;
+            }
+
+            group = nullptr;
+            if (processed < m_batch)
+            {
+                group = select(task);
+            }
+
+            if (nullptr == group)
+            {
+                // Still owns the pool if tasks are left after a full batch:
+                if (processed < m_batch || 0 == m_pending)
+                {
+                    --m_active;
+                    return;
+                }
+
+                break;
+            }
+        }
+
+        std::uint64_t start = clock_now_ns();
+
+        // Same treatment the workers of the pool give to their tasks:
+        ITask::run(*task);
+
+        task.reset();
+        elapsed = std::max<std::uint64_t>(clock_now_ns() - start, 1);
+        ++processed;
+    }
+
+    schedule();
+}
+
+// -----------------------------------------------------------------------------
+
+bool
+FairScheduler::is_eligible(const GroupState &group) const
+{
+    return !group.m_tasks.empty()
+            && (0 == group.m_max_concurrency
+                    || group.m_running < group.m_max_concurrency);
+}
+
+// -----------------------------------------------------------------------------
+
+FairScheduler::GroupState *
+FairScheduler::select(Task &task)
+{
+    const std::size_t count = m_groups.size();
+
+    for (;;)
+    {
+        // Serves the groups with credit left, starting from the current one:
+        bool eligible = false;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            GroupState &group = *m_groups[m_cursor];
+            if (is_eligible(group))
+            {
+                eligible = true;
+                if (group.m_deficit_ns > 0)
+                {
+                    task = group.m_tasks.front();
+                    group.m_tasks.pop_front();
+                    group.m_running++;
+                    --m_pending;
+
+                    // An idle group doesn't save credit for later:
+                    if (group.m_tasks.empty())
+                    {
+                        group.m_deficit_ns = 0;
+                    }
+
+                    return &group;
+                }
+            }
+
+            m_cursor = (m_cursor + 1) % count;
+        }
+
+        if (!eligible)
+        {
+            return nullptr;
+        }
+
+        // Skips the rounds in which no group would be served, each one
+        // crediting the quantum to every eligible group:
+        std::uint64_t rounds = std::numeric_limits<std::uint64_t>::max();
+        for (auto &group: m_groups)
+        {
+            if (is_eligible(*group))
+            {
+                std::uint64_t debt = std::uint64_t(-group->m_deficit_ns);
+                rounds = std::min(rounds, debt / group->m_quantum_ns + 1);
+            }
+        }
+
+        for (auto &group: m_groups)
+        {
+            if (is_eligible(*group))
+            {
+                group->m_deficit_ns += std::int64_t(rounds
+                        * group->m_quantum_ns);
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
@@ -0,0 +1,252 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef FAIRSCHEDULER_H
+#define FAIRSCHEDULER_H
+
+#include "Mutex.h"
+#include "Task.h"
+#include "ThreadPool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief Snapshot of the activity of one group of a @ref FairScheduler (see
+ * @ref FairScheduler::stats).
+ *
+ * @ingroup threading-high
+ */
+struct FairSchedulerGroupStats
+{
+    std::size_t pending;    ///< Number of tasks waiting to be executed.
+    std::size_t running;    ///< Number of tasks being executed.
+    std::uint64_t executed; ///< Number of tasks executed or cancelled.
+    std::uint64_t busy_ns;  ///< Time spent executing the tasks.
+
+    FairSchedulerGroupStats()
+            : pending(0),
+              running(0),
+              executed(0),
+              busy_ns(0)
+    {
+    }
+};
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief Shares the threads of a pool between groups of tasks in proportion
+ * to their weights.
+ *
+ * Every group has its own FIFO queue, so a burst of tasks in one group
+ * doesn't delay the tasks of the others behind it as the single queue of
+ * the pool does. The queues are served by deficit round robin: each round
+ * every group with pending tasks earns a credit of its weight times the
+ * quantum, and it is served while its credit is positive; the execution
+ * time of each task is charged to its group, so the groups share the time
+ * of the threads rather than the number of tasks.
+ *
+ * At most @a concurrency tasks of the scheduler run at the same time on the
+ * pool, and a group may be capped further to a maximum number of tasks
+ * running at the same time.
+ *
+ * Like the tasks posted to the pool (see @ref IThreadPool::post), the tasks
+ * of the scheduler are not collected after their execution; an exception
+ * thrown by a task is attached to it (see @ref ITask::has_failed) and a
+ * cancelled task (see @ref ITask::is_cancelled) is skipped and notified
+ * through @ref ITask::cancel.
+ *
+ * Example:
+ * @code
+   FairScheduler scheduler(*pool, 4);
+   FairScheduler::Group interactive = scheduler.add_group(4);
+   FairScheduler::Group batch = scheduler.add_group(1, 2);
+   scheduler.post(batch, task);
+ * @endcode
+ *
+ * @note
+ * - All methods are thread safe.
+ * - The same notes of @ref Actor about the pool and the lifetime apply.
+ * - Once the pool is shut down the tasks left into the groups are
+ *   cancelled (see @ref ITask::cancel).
+ *
+ * @ingroup threading-high
+ */
+class FairScheduler
+{
+
+public:
+
+    /**
+     * @brief Identifier of a group of tasks (see method @ref add_group).
+     */
+    typedef std::size_t Group;
+
+    /**
+     * @brief Default credit (nanoseconds) earned by a group of weight @a one
+     * each round.
+     */
+    static const std::uint64_t DEFAULT_QUANTUM_NS = 100000;
+
+    /**
+     * @brief Default number of tasks executed before giving the thread back
+     * to the pool.
+     */
+    static const std::size_t DEFAULT_BATCH = 64;
+
+    /**
+     * @brief Constructor.
+     *
+     * @param pool The thread pool executing the tasks.
+     *
+     * @param concurrency Maximum number of tasks running at the same time
+     *        on the pool, usually its number of threads.
+     *
+     * @param quantum_ns Credit (nanoseconds) earned by a group of weight
+     *        @a one each round.
+     *
+     * @param batch Maximum number of tasks executed before giving the thread
+     *        back to the pool.
+     */
+    FairScheduler(IThreadPool &pool,
+                  std::size_t concurrency,
+                  std::uint64_t quantum_ns = DEFAULT_QUANTUM_NS,
+                  std::size_t batch = DEFAULT_BATCH);
+
+    /**
+     * @brief Destructor.
+     */
+    ~FairScheduler();
+
+    /**
+     * @brief Adds one group of tasks.
+     *
+     * @param weight Share of the threads given to the group, relative to
+     *        the weights of the other groups with pending tasks.
+     *
+     * @param max_concurrency Maximum number of tasks of the group running
+     *        at the same time, @a zero for no limit other than the one of
+     *        the scheduler.
+     *
+     * @return The identifier of the new group.
+     *
+     * @pre
+     * - The parameter weight is greater than @a zero.
+     */
+    Group add_group(std::size_t weight, std::size_t max_concurrency = 0);
+
+    /**
+     * @brief Submits one task to a group.
+     *
+     * @param group The group of the task, returned by @ref add_group.
+     *
+     * @param task The task to be executed after the ones already submitted
+     *        to the same group.
+     *
+     * @pre
+     * - The parameter task is not null.
+     */
+    void post(Group group, Task task);
+
+    /**
+     * @brief Returns the number of tasks submitted but not yet executed.
+     */
+    std::size_t pending() const;
+
+    /**
+     * @brief Retrieves the counters of one group.
+     *
+     * @param group The group, returned by @ref add_group.
+     *
+     * @param[out] dst The snapshot to be filled.
+     */
+    void stats(Group group, FairSchedulerGroupStats &dst) const;
+
+private:
+
+    FairScheduler(const FairScheduler &);
+    FairScheduler &operator=(const FairScheduler &);
+
+    typedef ::Locker<Mutex> Locker;
+
+    friend class FairSchedulerTask;
+
+    struct GroupState
+    {
+        std::deque<Task> m_tasks;
+        std::uint64_t m_quantum_ns;
+        std::size_t m_max_concurrency;
+        std::size_t m_running;
+
+        // Credit left for the current round, may go negative when a task
+        // runs longer than the credit:
+        std::int64_t m_deficit_ns;
+
+        std::uint64_t m_executed;
+        std::uint64_t m_busy_ns;
+    };
+
+    void schedule();
+
+    void run();
+
+    void abandon();
+
+    bool is_eligible(const GroupState &group) const;
+
+    GroupState *select(Task &task);
+
+    IThreadPool &m_pool;
+    std::size_t m_concurrency;
+    std::uint64_t m_quantum_ns;
+    std::size_t m_batch;
+
+    mutable Mutex m_mutex;
+    std::vector<std::unique_ptr<GroupState> > m_groups;
+
+    // Group served by the current round:
+    std::size_t m_cursor;
+
+    // Tasks queued in all the groups:
+    std::size_t m_pending;
+
+    // Tasks of the scheduler posted to the pool:
+    std::size_t m_active;
+
+};
+
+// ----------------------------------------------------------------------------
+
+#endif // FAIRSCHEDULER_H
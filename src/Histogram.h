@@ -0,0 +1,335 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Immutable copy of the content of a @ref Histogram.
+ *
+ * @ingroup threading-base
+ */
+struct HistogramSnapshot
+{
+    /**
+     * @brief Number of values recorded into each bucket.
+     */
+    std::vector<std::uint64_t> buckets;
+
+    /**
+     * @brief Total number of recorded values.
+     */
+    std::uint64_t count;
+
+    /**
+     * @brief Sum of all recorded values.
+     */
+    std::uint64_t sum;
+
+    /**
+     * @brief Greatest recorded value.
+     */
+    std::uint64_t max;
+
+    HistogramSnapshot()
+            : count(0),
+              sum(0),
+              max(0)
+    {
+    }
+
+    /**
+     * @brief Returns the average of the recorded values.
+     */
+    inline double mean() const;
+
+    /**
+     * @brief Returns an upper bound for the value below which the given
+     * percentage of the recorded values falls.
+     *
+     * @param percent Percentile in the range [0, 100] (e.g. 99.9).
+     *
+     * @return The upper bound of the bucket holding the percentile (clamped
+     *         to the greatest recorded value) or @a zero if the histogram is
+     *         empty.
+     */
+    inline std::uint64_t percentile(double percent) const;
+
+    /**
+     * @brief Adds the content of another snapshot to this one.
+     */
+    inline void merge(const HistogramSnapshot &other);
+};
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Lock-free histogram of unsigned 64 bits values with logarithmic
+ * buckets.
+ *
+ * Values are grouped by powers of two, each one split in @ref
+ * SUB_BUCKET_COUNT linear sub-buckets (the same layout used by HDR
+ * histograms), so that the relative error of any reported value is below
+ * 1 / @ref SUB_BUCKET_COUNT whatever its magnitude.
+ *
+ * Recording a value costs a few relaxed atomic increments and never blocks,
+ * hence the class can be safely updated by many threads concurrently.
+ *
+ * @ingroup threading-base
+ */
+class Histogram
+{
+
+public:
+
+    /**
+     * @brief Number of bits used to index the sub-buckets of each power of
+     * two.
+     */
+    static const unsigned SUB_BUCKET_BITS = 4;
+
+    /**
+     * @brief Number of linear sub-buckets for each power of two.
+     */
+    static const std::size_t SUB_BUCKET_COUNT = 1u << SUB_BUCKET_BITS;
+
+    /**
+     * @brief Total number of buckets needed to cover all 64 bits values.
+     */
+    static const std::size_t BUCKET_COUNT =
+            (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    Histogram()
+    {
+        reset();
+    }
+
+    /**
+     * @brief Records one value.
+     */
+    void
+    record(std::uint64_t value)
+    {
+        m_buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+
+        std::uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (value > max
+               && !m_max.compare_exchange_weak(max, value,
+                                               std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /**
+     * @brief Copies the current content of the histogram.
+     *
+     * @note The copy is not atomic with respect to concurrent calls to
+     * @ref record, it can miss some of the values recorded meanwhile.
+     */
+    void
+    snapshot(HistogramSnapshot &dst) const
+    {
+        dst.buckets.resize(BUCKET_COUNT);
+        for (std::size_t i = 0; i < BUCKET_COUNT; ++i)
+        {
+            dst.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+        }
+
+        dst.count = m_count.load(std::memory_order_relaxed);
+        dst.sum = m_sum.load(std::memory_order_relaxed);
+        dst.max = m_max.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Discards all the recorded values.
+     */
+    void
+    reset()
+    {
+        for (std::size_t i = 0; i < BUCKET_COUNT; ++i)
+        {
+            m_buckets[i].store(0, std::memory_order_relaxed);
+        }
+
+        m_count.store(0, std::memory_order_relaxed);
+        m_sum.store(0, std::memory_order_relaxed);
+        m_max.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Returns the index of the bucket counting the passed value.
+     */
+    static std::size_t
+    bucket_index(std::uint64_t value)
+    {
+        if (value < SUB_BUCKET_COUNT)
+        {
+            return std::size_t(value);
+        }
+
+        unsigned exponent = most_significant_bit(value);
+        unsigned shift = exponent - SUB_BUCKET_BITS;
+        std::size_t mantissa = std::size_t(value >> shift) - SUB_BUCKET_COUNT;
+
+        return (shift + 1) * SUB_BUCKET_COUNT + mantissa;
+    }
+
+    /**
+     * @brief Returns the smallest value counted by the passed bucket.
+     */
+    static std::uint64_t
+    bucket_lower_bound(std::size_t index)
+    {
+        if (index < SUB_BUCKET_COUNT)
+        {
+            return index;
+        }
+
+        unsigned shift = unsigned(index / SUB_BUCKET_COUNT) - 1;
+        std::uint64_t mantissa = index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT;
+
+        return mantissa << shift;
+    }
+
+    /**
+     * @brief Returns the greatest value counted by the passed bucket.
+     */
+    static std::uint64_t
+    bucket_upper_bound(std::size_t index)
+    {
+        if (index < SUB_BUCKET_COUNT)
+        {
+            return index;
+        }
+
+        unsigned shift = unsigned(index / SUB_BUCKET_COUNT) - 1;
+
+        return bucket_lower_bound(index) + ((std::uint64_t(1) << shift) - 1);
+    }
+
+private:
+
+    static unsigned
+    most_significant_bit(std::uint64_t value)
+    {
+#if defined(__GNUC__)
+        return 63 - unsigned(__builtin_clzll(value));
+#else
+        unsigned bit = 0;
+        while (value >>= 1)
+        {
+            ++bit;
+        }
+        return bit;
+#endif
+    }
+
+    std::atomic<std::uint64_t> m_buckets[BUCKET_COUNT];
+    std::atomic<std::uint64_t> m_count;
+    std::atomic<std::uint64_t> m_sum;
+    std::atomic<std::uint64_t> m_max;
+
+    Histogram(const Histogram &);
+    Histogram &operator=(const Histogram &);
+
+};
+
+// -----------------------------------------------------------------------------
+
+double
+HistogramSnapshot::mean() const
+{
+    return count > 0 ? double(sum) / double(count) : 0.0;
+}
+
+// -----------------------------------------------------------------------------
+
+std::uint64_t
+HistogramSnapshot::percentile(double percent) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    std::uint64_t rank = std::uint64_t(percent / 100.0 * double(count) + 0.5);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < buckets.size(); ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            std::uint64_t bound = Histogram::bucket_upper_bound(i);
+            return bound < max ? bound : max;
+        }
+    }
+
+    return max;
+}
+
+// -----------------------------------------------------------------------------
+
+void
+HistogramSnapshot::merge(const HistogramSnapshot &other)
+{
+    if (buckets.size() < other.buckets.size())
+    {
+        buckets.resize(other.buckets.size(), 0);
+    }
+
+    for (std::size_t i = 0; i < other.buckets.size(); ++i)
+    {
+        buckets[i] += other.buckets[i];
+    }
+
+    count += other.count;
+    sum += other.sum;
+    if (other.max > max)
+    {
+        max = other.max;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,244 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include "Message.h"
+
+#include <atomic>
+#include <memory>
+
+#include <assert.h>
+
+// ----------------------------------------------------------------------------
+
+class IMailboxMessage;
+
+/**
+ * @brief Shared pointer for abstract interface @ref IMailboxMessage.
+ *
+ * @ingroup threading-high
+ */
+typedef std::shared_ptr<IMailboxMessage> MailboxMessage;
+
+/**
+ * @brief Abstract class to be implemented by the messages exchanged through a
+ * @ref Mailbox.
+ *
+ * The message embeds the link used by the mailbox to chain it to the next
+ * one, hence queuing it doesn't allocate any memory.
+ *
+ * @note A message can be queued into one mailbox at a time.
+ *
+ * @ingroup threading-high
+ */
+class IMailboxMessage
+        : public IMessage
+{
+
+public:
+
+    /**
+     * @brief Default constructor.
+     */
+    IMailboxMessage()
+            : m_next(nullptr)
+    {
+    }
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~IMailboxMessage()
+    {
+    }
+
+private:
+
+    friend class Mailbox;
+
+    std::atomic<IMailboxMessage *> m_next;
+
+    // Keeps the message alive while it is queued:
+    MailboxMessage m_self;
+
+};
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief Unbounded multi-producer/single-consumer intrusive message queue.
+ *
+ * Implements the non-blocking queue by Dmitry Vyukov: producers link their
+ * message with one atomic exchange on the head of the list and the consumer
+ * walks the list from its tail without any atomic read-modify-write
+ * operation. The queue holds no mutex and never allocates memory.
+ *
+ * @note
+ * - @ref push can be called by any thread at any time, @ref pop by only one
+ *   thread at a time.
+ * - While a producer is in the middle of @ref push the consumer may not see
+ *   its message (and the ones pushed after it) for a short while: @ref pop
+ *   returns @a false in that case even if the mailbox is not empty.
+ *
+ * @ingroup threading-high
+ */
+class Mailbox
+{
+
+public:
+
+    /**
+     * @brief Constructor.
+     */
+    Mailbox()
+            : m_head(&m_stub),
+              m_tail(&m_stub)
+    {
+    }
+
+    /**
+     * @brief Destructor, releases the messages still queued.
+     */
+    ~Mailbox()
+    {
+        MailboxMessage message;
+        while (pop(message))
+        {
+        }
+    }
+
+    /**
+     * @brief Pushes one message into the mailbox.
+     *
+     * @param message The message to be inserted.
+     *
+     * @pre
+     * - The parameter message is not null.
+     * - The message is not queued into any mailbox.
+     */
+    void
+    push(MailboxMessage message)
+    {
+        assert(nullptr != message.get());
+        assert(nullptr == message->m_self.get());
+
+        IMailboxMessage *node = message.get();
+        node->m_self = std::move(message);
+        link(node);
+    }
+
+    /**
+     * @brief Pops the oldest message from the mailbox.
+     *
+     * @param[out] message Smart pointer that will be reset with the popped
+     *             message in case of success.
+     *
+     * @return @a true on success, @a false if no message is available
+     *         (parameter message is not touched in that case).
+     *
+     * @pre
+     * - Called by one thread at a time.
+     */
+    bool
+    pop(MailboxMessage &message)
+    {
+        IMailboxMessage *tail = m_tail;
+        IMailboxMessage *next = tail->m_next.load(std::memory_order_acquire);
+
+        // Skips the stub:
+        if (tail == &m_stub)
+        {
+            if (nullptr == next)
+            {
+                return false;
+            }
+
+            m_tail = next;
+            tail = next;
+            next = next->m_next.load(std::memory_order_acquire);
+        }
+
+        if (nullptr == next)
+        {
+            // A producer swapped the head but didn't link it yet:
+            if (tail != m_head.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+
+            // The tail is the last message, the stub takes its place:
+            link(&m_stub);
+            next = tail->m_next.load(std::memory_order_acquire);
+            if (nullptr == next)
+            {
+                return false;
+            }
+        }
+
+        m_tail = next;
+
+        message = std::move(tail->m_self);
+        return true;
+    }
+
+private:
+
+    Mailbox(const Mailbox &);
+    Mailbox &operator=(const Mailbox &);
+
+    void
+    link(IMailboxMessage *node)
+    {
+        node->m_next.store(nullptr, std::memory_order_relaxed);
+        IMailboxMessage *prev = m_head.exchange(node,
+                                                std::memory_order_acq_rel);
+        prev->m_next.store(node, std::memory_order_release);
+    }
+
+    class Stub
+            : public IMailboxMessage
+    {
+    };
+
+    // Written by the producers:
+    std::atomic<IMailboxMessage *> m_head;
+
+    char m_padding[64];
+
+    // Written by the consumer:
+    IMailboxMessage *m_tail;
+    Stub m_stub;
+
+};
+
+// ----------------------------------------------------------------------------
+
+#endif // MAILBOX_H
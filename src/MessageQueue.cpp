@@ -30,28 +30,102 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "MessageQueue.h"
 #include "Mutex.h"
 #include "Cond.h"
+#include "EventFd.h"
+#include "Probes.h"
 
+#include <algorithm>
+#include <atomic>
 #include <deque>
+#include <memory>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+class MessageQueueReadiness: public IMessageQueueListener
+{
+
+public:
+
+    EventFd m_event_fd;
+
+    virtual void
+    on_ready(IMessageQueue &queue)
+    {
+        (void) queue;
+
+        m_event_fd.signal();
+    }
+
+};
 
 // -----------------------------------------------------------------------------
 
 class MessageQueueImpl: public IMessageQueue
 {
-    typedef Locker<Mutex> Locker;
+    typedef ::Locker<Mutex> Locker;
+
+    // Message pushed with a key, the sequence keeps the equal keys in FIFO
+    // order:
+    struct OrderedEntry
+    {
+        std::uint64_t m_key;
+        std::uint64_t m_sequence;
+        Message m_message;
+    };
+
+    // Orders the heap of the ordered messages with the lowest key on top:
+    struct OrderedLater
+    {
+        bool
+        operator()(const OrderedEntry &a, const OrderedEntry &b) const
+        {
+            return a.m_key > b.m_key
+                    || (a.m_key == b.m_key && a.m_sequence > b.m_sequence);
+        }
+    };
 
     std::size_t m_max_capacity;
-    volatile bool m_cancelled;
+    WaitStrategy m_wait_strategy;
+    std::atomic<bool> m_cancelled;
+    std::atomic<bool> m_closed;
 
     mutable Mutex m_mutex;
     mutable Cond m_cond;
+    mutable Cond m_space_cond;
     std::deque<Message> m_queue;
+    std::vector<OrderedEntry> m_ordered;
+    std::uint64_t m_sequence;
+    std::size_t m_waiters;
+    std::size_t m_push_waiters;
+    std::vector<IMessageQueueListener *> m_listeners;
+    std::unique_ptr<MessageQueueReadiness> m_readiness;
+
+    // Modified only while the mutex is held, atomic to let the readers skip
+    // the mutex:
+    std::atomic<std::size_t> m_size;
+    std::atomic<std::size_t> m_high_watermark;
+    std::atomic<std::uint64_t> m_pushed;
+    std::atomic<std::uint64_t> m_popped;
+    std::atomic<std::uint64_t> m_rejected;
 
 public:
 
-    MessageQueueImpl(std::size_t max_capacity)
+    MessageQueueImpl(std::size_t max_capacity,
+                     const WaitStrategy &wait_strategy)
             :
             m_max_capacity(max_capacity),
-            m_cancelled(false)
+            m_wait_strategy(wait_strategy),
+            m_cancelled(false),
+            m_closed(false),
+            m_mutex("MessageQueue"),
+            m_sequence(0),
+            m_waiters(0),
+            m_push_waiters(0),
+            m_size(0),
+            m_high_watermark(0),
+            m_pushed(0),
+            m_popped(0),
+            m_rejected(0)
     {
     }
 
@@ -72,75 +146,167 @@ public:
         // Blocking implementation:
         if (blocking)
         {
+            poll_not_empty();
             Locker locker(m_mutex);
 
-            while (!m_cancelled) // <- while needed because of spurious wake-ups.
+            if (wait_not_empty())
             {
-                ret = m_queue.size();
-                if (ret > 0)
-                {
-                    message = m_queue.front();
-                    m_queue.pop_front();
-                    break;
-                }
-
-                m_cond.wait(m_mutex); // Performs unlock-wait-lock op.
-                if (m_cancelled)
-                {
-                    break;
-                }
+                ret = count();
+                extract(message);
             }
         }
         else
         {
             Locker locker(m_mutex);
 
-            ret = m_queue.size();
+            ret = count();
             if (ret > 0)
             {
-                message = m_queue.front();
-                m_queue.pop_front();
+                extract(message);
             }
         }
 
+        TP_PROBE2(queue__pop, this, ret);
+
         return ret;
     }
 
     // -------------------------------------------------------------------------
 
     virtual std::size_t
-    push(Message message)
+    pop_all(std::deque<Message> &messages,
+            std::size_t max_count,
+            bool blocking)
     {
         std::size_t ret = 0;
+        if (blocking)
+        {
+            poll_not_empty();
+        }
+
         Locker locker(m_mutex);
 
-        ret = m_queue.size();
-        if (ret < m_max_capacity)
+        if (!blocking || wait_not_empty())
         {
-            m_queue.push_back(message);
+            ret = std::min(count(), max_count);
 
-            ret++;
-            if (ret == 1)
+            // The ordered messages come first:
+            std::size_t taken = 0;
+            for (; taken < ret && !m_ordered.empty(); ++taken)
             {
-                m_cond.signal();
+                messages.push_back(extract_ordered());
+            }
+
+            if (0 == taken && ret == m_queue.size() && messages.empty())
+            {
+                // Takes the whole buffer at once:
+                messages.swap(m_queue);
+            }
+            else
+            {
+                for (; taken < ret; ++taken)
+                {
+                    messages.push_back(std::move(m_queue.front()));
+                    m_queue.pop_front();
+                }
+            }
+
+            m_size.store(count(), std::memory_order_relaxed);
+            m_popped.store(m_popped.load(std::memory_order_relaxed) + ret,
+                           std::memory_order_relaxed);
+
+            if (ret > 0 && m_push_waiters > 0)
+            {
+                m_space_cond.broadcast();
+            }
+        }
+
+        TP_PROBE2(queue__pop, this, ret);
+
+        return ret;
+    }
+
+    // -------------------------------------------------------------------------
+
+    virtual std::size_t
+    evict(Message &message, Evictable evictable)
+    {
+        Locker locker(m_mutex);
+
+        std::size_t ret = count();
+        auto oldest = m_queue.begin();
+        while (oldest != m_queue.end()
+               && nullptr != evictable && !evictable(**oldest))
+        {
+            ++oldest;
+        }
+
+        // The ordered one with the greatest key otherwise, it's a leaf of
+        // the heap:
+        auto latest = m_ordered.end();
+        if (oldest == m_queue.end())
+        {
+            for (auto i = m_ordered.begin(); i != m_ordered.end(); ++i)
+            {
+                if ((nullptr == evictable || evictable(*i->m_message))
+                    && (latest == m_ordered.end()
+                        || OrderedLater()(*i, *latest)))
+                {
+                    latest = i;
+                }
             }
         }
+
+        if (oldest != m_queue.end())
+        {
+            message = *oldest;
+            m_queue.erase(oldest);
+            extracted();
+        }
+        else if (latest != m_ordered.end())
+        {
+            message = std::move(latest->m_message);
+            m_ordered.erase(latest);
+            std::make_heap(m_ordered.begin(), m_ordered.end(),
+                           OrderedLater());
+            extracted();
+        }
         else
         {
-            ret = 0; // Failure.
+            ret = 0;
         }
 
+        TP_PROBE2(queue__pop, this, ret);
+
         return ret;
     }
 
     // -------------------------------------------------------------------------
 
+    virtual std::size_t
+    push(Message message, bool blocking)
+    {
+        return insert(message, false, 0, blocking);
+    }
+
+    // -------------------------------------------------------------------------
+
+    virtual std::size_t
+    push_ordered(Message message, std::uint64_t key, bool blocking)
+    {
+        return insert(message, true, key, blocking);
+    }
+
+    // -------------------------------------------------------------------------
+
     virtual void
     cancel()
     {
         Locker locker(m_mutex);
         m_cancelled = true;
         m_cond.broadcast();
+        m_space_cond.broadcast();
+        notify_listeners();
     }
 
     // -------------------------------------------------------------------------
@@ -153,12 +319,288 @@ public:
 
     // -------------------------------------------------------------------------
 
+    virtual void
+    close()
+    {
+        Locker locker(m_mutex);
+        m_closed = true;
+        m_cond.broadcast();
+        m_space_cond.broadcast();
+        notify_listeners();
+    }
+
+    // -------------------------------------------------------------------------
+
+    virtual bool
+    is_closed() const
+    {
+        return m_closed;
+    }
+
+    // -------------------------------------------------------------------------
+
     virtual
     std::size_t
     size() const
+    {
+        return m_size.load(std::memory_order_relaxed);
+    }
+
+    // -------------------------------------------------------------------------
+
+    virtual void
+    stats(MessageQueueStats &dst) const
+    {
+        dst.size = m_size.load(std::memory_order_relaxed);
+        dst.high_watermark = m_high_watermark.load(std::memory_order_relaxed);
+        dst.pushed = m_pushed.load(std::memory_order_relaxed);
+        dst.popped = m_popped.load(std::memory_order_relaxed);
+        dst.rejected = m_rejected.load(std::memory_order_relaxed);
+    }
+
+    // -------------------------------------------------------------------------
+
+    virtual void
+    add_listener(IMessageQueueListener *listener)
+    {
+        assert(nullptr != listener);
+
+        Locker locker(m_mutex);
+        m_listeners.push_back(listener);
+    }
+
+    // -------------------------------------------------------------------------
+
+    virtual void
+    remove_listener(IMessageQueueListener *listener)
     {
         Locker locker(m_mutex);
-        return m_queue.size();
+        m_listeners.erase(std::remove(m_listeners.begin(),
+                                      m_listeners.end(),
+                                      listener),
+                          m_listeners.end());
+    }
+
+    // -------------------------------------------------------------------------
+
+    virtual int
+    readiness_fd()
+    {
+        Locker locker(m_mutex);
+
+        if (!m_readiness)
+        {
+            m_readiness.reset(new MessageQueueReadiness());
+            m_listeners.push_back(m_readiness.get());
+
+            // Already ready, no transition is going to signal it:
+            if (count() > 0 || m_closed || m_cancelled)
+            {
+                m_readiness->m_event_fd.signal();
+            }
+        }
+
+        return m_readiness->m_event_fd.fd();
+    }
+
+    // -------------------------------------------------------------------------
+
+    virtual void
+    clear_readiness()
+    {
+        assert(m_readiness);
+
+        m_readiness->m_event_fd.clear();
+    }
+
+private:
+
+    // Inserts one message, ordered by key or at the back of the queue:
+    std::size_t
+    insert(Message message, bool ordered, std::uint64_t key, bool blocking)
+    {
+        std::size_t ret = 0;
+        Locker locker(m_mutex);
+
+        if (blocking)
+        {
+            wait_not_full();
+        }
+
+        ret = count();
+        if (ret < m_max_capacity && !m_closed)
+        {
+            if (ordered)
+            {
+                OrderedEntry entry;
+                entry.m_key = key;
+                entry.m_sequence = m_sequence++;
+                entry.m_message = message;
+                m_ordered.push_back(std::move(entry));
+                std::push_heap(m_ordered.begin(), m_ordered.end(),
+                               OrderedLater());
+            }
+            else
+            {
+                m_queue.push_back(message);
+            }
+
+            ret++;
+            m_size.store(ret, std::memory_order_relaxed);
+            increment(m_pushed);
+            if (ret > m_high_watermark.load(std::memory_order_relaxed))
+            {
+                m_high_watermark.store(ret, std::memory_order_relaxed);
+            }
+
+            // Every message may be needed to wake up a different consumer:
+            if (m_waiters > 0)
+            {
+                m_cond.signal();
+            }
+
+            if (1 == ret)
+            {
+                notify_listeners();
+            }
+        }
+        else
+        {
+            ret = 0; // Failure.
+            increment(m_rejected);
+        }
+
+        TP_PROBE2(queue__push, this, ret);
+
+        return ret;
+    }
+
+    // The mutex must be locked:
+    void
+    notify_listeners()
+    {
+        for (auto listener: m_listeners)
+        {
+            listener->on_ready(*this);
+        }
+    }
+
+    // Polls the queue without locking it before a blocking pop parks: while
+    // polling the consumer doesn't count as a waiter, so the producers don't
+    // have to wake it up.
+    void
+    poll_not_empty() const
+    {
+        if (m_wait_strategy.parks_immediately())
+        {
+            return;
+        }
+
+        m_wait_strategy.poll([this]()
+        {
+            return m_size.load(std::memory_order_relaxed) > 0
+                    || m_closed.load(std::memory_order_relaxed)
+                    || m_cancelled.load(std::memory_order_relaxed);
+        });
+    }
+
+    // Waits until the queue is not empty, returns false if it gets cancelled
+    // or closed and drained first. The mutex must be locked:
+    bool
+    wait_not_empty()
+    {
+        while (!m_cancelled) // <- while needed because of spurious wake-ups.
+        {
+            if (count() > 0)
+            {
+                return true;
+            }
+
+            // Drained:
+            if (m_closed)
+            {
+                break;
+            }
+
+            TP_PROBE1(queue__wait__start, this);
+            ++m_waiters;
+            m_cond.wait(m_mutex); // Performs unlock-wait-lock op.
+            --m_waiters;
+            TP_PROBE1(queue__wait__done, this);
+        }
+
+        return false;
+    }
+
+    // Waits until the queue has room for one more message or until it gets
+    // cancelled or closed. The mutex must be locked:
+    void
+    wait_not_full()
+    {
+        while (count() >= m_max_capacity && !m_closed && !m_cancelled)
+        {
+            ++m_push_waiters;
+            m_space_cond.wait(m_mutex); // Performs unlock-wait-lock op.
+            --m_push_waiters;
+        }
+    }
+
+    // Number of queued messages, the mutex must be locked:
+    std::size_t
+    count() const
+    {
+        return m_queue.size() + m_ordered.size();
+    }
+
+    // Pops the front message, the ordered ones first. The mutex must be
+    // locked and the queue must not be empty:
+    void
+    extract(Message &message)
+    {
+        if (!m_ordered.empty())
+        {
+            message = extract_ordered();
+        }
+        else
+        {
+            message = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        extracted();
+    }
+
+    // Accounts for one message removed, the mutex must be locked:
+    void
+    extracted()
+    {
+        m_size.store(count(), std::memory_order_relaxed);
+        increment(m_popped);
+
+        if (m_push_waiters > 0)
+        {
+            m_space_cond.signal();
+        }
+    }
+
+    // Pops the ordered message with the lowest key, the mutex must be locked
+    // and the heap must not be empty:
+    Message
+    extract_ordered()
+    {
+        std::pop_heap(m_ordered.begin(), m_ordered.end(), OrderedLater());
+        Message message = std::move(m_ordered.back().m_message);
+        m_ordered.pop_back();
+
+        return message;
+    }
+
+    // No need for an atomic read-modify-write since the mutex is held:
+    static void
+    increment(std::atomic<std::uint64_t> &counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
     }
 
 };
@@ -168,7 +610,16 @@ public:
 IMessageQueue *
 IMessageQueue::create(std::size_t max_capacity)
 {
-    return new MessageQueueImpl(max_capacity);
+    return new MessageQueueImpl(max_capacity, WaitStrategy());
+}
+
+// -----------------------------------------------------------------------------
+
+IMessageQueue *
+IMessageQueue::create(std::size_t max_capacity,
+                      const WaitStrategy &wait_strategy)
+{
+    return new MessageQueueImpl(max_capacity, wait_strategy);
 }
 
 // -----------------------------------------------------------------------------
@@ -31,8 +31,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MESSAGEQUEUE_H
 
 #include "Message.h"
+#include "WaitStrategy.h"
 
 #include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <limits>
 #include <memory>
 
@@ -40,6 +43,69 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 // ----------------------------------------------------------------------------
 
+/**
+ * @brief Snapshot of the counters of a message queue (see @ref
+ * IMessageQueue::stats).
+ *
+ * @ingroup threading-high
+ */
+struct MessageQueueStats
+{
+    std::size_t size;            ///< Number of queued messages.
+    std::size_t high_watermark;  ///< Greatest number of queued messages.
+    std::uint64_t pushed;        ///< Number of successful insertions.
+    std::uint64_t popped;        ///< Number of successful extractions.
+    std::uint64_t rejected;      ///< Insertions failed because of the capacity
+                                 ///< or because the queue was closed.
+
+    MessageQueueStats()
+            : size(0),
+              high_watermark(0),
+              pushed(0),
+              popped(0),
+              rejected(0)
+    {
+    }
+};
+
+// ----------------------------------------------------------------------------
+
+class IMessageQueue;
+
+/**
+ * @brief Abstract class to be implemented to be notified about the changes
+ * of state of a message queue (see @ref IMessageQueue::add_listener).
+ *
+ * @ingroup threading-high
+ */
+class IMessageQueueListener
+{
+
+public:
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~IMessageQueueListener()
+    {
+    }
+
+    /**
+     * @brief Called when the queue may have become ready: a message has been
+     * pushed into the empty queue, or the queue has been closed or
+     * cancelled.
+     *
+     * @param queue The notifying queue.
+     *
+     * @warning The method is called while the queue is locked: it must be
+     * quick and must not call any method of the queue.
+     */
+    virtual void on_ready(IMessageQueue &queue) = 0;
+
+};
+
+// ----------------------------------------------------------------------------
+
 /**
  * @brief General purpose message queue for inter-thread communication.
  *
@@ -75,6 +141,21 @@ public:
     static IMessageQueue *create(std::size_t max_capacity
                                      = std::numeric_limits<std::size_t>::max());
 
+    /**
+     * @brief Factory method to create a message queue implemented for the
+     * current platform, whose blocking consumers poll before parking.
+     *
+     * @param max_capacity Maximum number of messages that can be queued at
+     *        the same time.
+     *
+     * @param wait_strategy How the blocking @ref pop and @ref pop_all poll
+     *        the queue before parking the calling thread.
+     *
+     * @return The newly created message queue.
+     */
+    static IMessageQueue *create(std::size_t max_capacity,
+                                 const WaitStrategy &wait_strategy);
+
     /**
     * @brief Destructor.
      */
@@ -91,13 +172,59 @@ public:
      * - On success, the number of messages contained by the queue after the
      *   insertion, that is at least @a one.
      * - On failure, @a zero. This may happen if the maximum allowed capacity
-     *   for the queue have been reached.
+     *   for the queue have been reached or if the queue have been closed.
      *
      * @pre
      * - The parameter message is not null.
      * - The queue have not been cancelled.
      */
-    virtual std::size_t push(Message message) = 0;
+    std::size_t push(Message message)
+    {
+        return push(message, false);
+    }
+
+    /**
+     * @brief Pushes one message into the queue, optionally waiting for room.
+     *
+     * @param message The message to be inserted.
+     *
+     * @param blocking If set to @a true and the queue is full the method
+     *        blocks the current thread until another thread pops a message or
+     *        until the queue is cancelled or closed.
+     *
+     * @return The same as @ref push(Message).
+     *
+     * @pre
+     * - The parameter message is not null.
+     */
+    virtual std::size_t push(Message message, bool blocking) = 0;
+
+    /**
+     * @brief Pushes one message into the queue ahead of the messages pushed
+     * by @ref push, ordered by a key.
+     *
+     * The messages pushed by this method are popped before the other ones,
+     * in increasing order of key; the messages with the same key are popped
+     * in the order they have been pushed. For instance, with their deadlines
+     * as keys the messages are popped earliest-deadline-first.
+     *
+     * @warning The other messages are popped only once no ordered message is
+     * left: a steady stream of ordered messages starves them indefinitely.
+     *
+     * @param message The message to be inserted.
+     *
+     * @param key The ordering key of the message.
+     *
+     * @param blocking The same as @ref push(Message, bool).
+     *
+     * @return The same as @ref push(Message).
+     *
+     * @pre
+     * - The parameter message is not null.
+     */
+    virtual std::size_t push_ordered(Message message,
+                                     std::uint64_t key,
+                                     bool blocking) = 0;
 
     /**
      * @brief Pops one message from the queue.
@@ -107,7 +234,8 @@ public:
      *
      * @param blocking If set to @a true the method blocks the current thread
      *        indefinitely until a new message is pushed into the queue by
-     *        another thread or until the queue is not cancelled.
+     *        another thread or until the queue is cancelled or closed and
+     *        empty.
      *
      * @return
      * - On success, the number of messages contained by the queue before the
@@ -119,6 +247,70 @@ public:
      */
     virtual std::size_t pop(Message &message, bool blocking) = 0;
 
+    /**
+     * @brief Pops many messages from the queue at once.
+     *
+     * The messages are extracted in the order @ref pop would extract them
+     * while holding the lock of the queue once: the messages pushed by @ref
+     * push_ordered first, in increasing order of key, then the other ones in
+     * their order of insertion. When all the queued messages are requested,
+     * none of them is ordered and the destination is empty, the whole buffer
+     * of the queue is swapped in, without moving the messages one by one.
+     *
+     * @param[out] messages Container the popped messages are appended to.
+     *
+     * @param max_count Maximum number of messages to be popped.
+     *
+     * @param blocking If set to @a true the method blocks the current thread
+     *        like @ref pop until at least one message can be popped.
+     *
+     * @return The number of popped messages, @a zero if none.
+     *
+     * @pre
+     * - The queue have not been cancelled.
+     */
+    virtual std::size_t pop_all(std::deque<Message> &messages,
+                                std::size_t max_count,
+                                bool blocking) = 0;
+
+    /**
+     * @brief Predicate telling whether a message can be removed by @ref
+     * evict.
+     */
+    typedef bool (*Evictable)(const IMessage &message);
+
+    /**
+     * @brief Removes the oldest message pushed by @ref push, or when there is
+     * none the ordered message with the greatest key (see @ref
+     * push_ordered), the most urgent messages are kept.
+     *
+     * @param[out] message Smart pointer that will be reset with the removed
+     *             message in case of success.
+     *
+     * @return The same as @ref pop, never blocks.
+     *
+     * @pre
+     * - The queue have not been cancelled.
+     */
+    std::size_t evict(Message &message)
+    {
+        return evict(message, nullptr);
+    }
+
+    /**
+     * @brief Removes a message like @ref evict(Message &), among the ones
+     * accepted by a predicate.
+     *
+     * @param[out] message The same as @ref evict(Message &).
+     *
+     * @param evictable The messages it returns @a false for are skipped,
+     *        if null every message can be removed.
+     *
+     * @return The same as @ref evict(Message &), @a zero if no message
+     *         can be removed.
+     */
+    virtual std::size_t evict(Message &message, Evictable evictable) = 0;
+
     /**
      * @brief Cancel the queue functionality indefinitely releasing any blocked
      * thread.
@@ -136,11 +328,84 @@ public:
      */
     virtual bool is_cancelled() const = 0;
 
+    /**
+     * @brief Closes the queue for insertions while letting the consumers
+     * drain the messages it still contains.
+     *
+     * After this call every @ref push fails while @ref pop keeps extracting
+     * the queued messages; once the queue is empty a blocking @ref pop
+     * returns @a zero instead of waiting, marking the end of the stream.
+     * Blocked consumers are released.
+     *
+     * Unlike @ref cancel no queued message is abandoned. The closed status is
+     * not reversible.
+     */
+    virtual void close() = 0;
+
+    /**
+     * @brief Returns @a true if the queue have been closed.
+     */
+    virtual bool is_closed() const = 0;
+
     /**
      * @brief Returns the number of messages contained inside the queue.
+     *
+     * @note Doesn't block, the value is read without any lock.
      */
     virtual std::size_t size() const = 0;
 
+    /**
+     * @brief Copies the counters of the queue.
+     *
+     * @note Doesn't block, the counters are read without any lock hence they
+     * may be slightly out of sync with each other.
+     */
+    virtual void stats(MessageQueueStats &dst) const = 0;
+
+    /**
+     * @brief Registers a listener to be notified when the queue may have
+     * become ready (see @ref IMessageQueueListener::on_ready).
+     *
+     * @param listener The listener, it must stay alive until it is removed
+     *        (see method @ref remove_listener).
+     */
+    virtual void add_listener(IMessageQueueListener *listener) = 0;
+
+    /**
+     * @brief Unregisters a listener added with @ref add_listener.
+     *
+     * Once the method returns the listener is not called any more.
+     */
+    virtual void remove_listener(IMessageQueueListener *listener) = 0;
+
+    /**
+     * @brief Returns a file descriptor that becomes readable when the queue
+     * may have become ready, to wait for the queue into a @a poll, @a epoll
+     * or @a select loop.
+     *
+     * The descriptor is created by the first call, afterwards it is
+     * signalled when a message is pushed into the empty queue or when the
+     * queue is closed or cancelled, with at most one system call for each
+     * transition (see @ref EventFd).
+     *
+     * Once the descriptor is reported readable the consumer calls @ref
+     * clear_readiness and then pops (without blocking) until the queue is
+     * empty.
+     *
+     * @return The descriptor, owned by the queue: it must not be read or
+     *         closed by the user.
+     */
+    virtual int readiness_fd() = 0;
+
+    /**
+     * @brief Makes the descriptor returned by @ref readiness_fd non readable,
+     * to be called before draining the queue.
+     *
+     * @pre
+     * - The method @ref readiness_fd have already been called.
+     */
+    virtual void clear_readiness() = 0;
+
     /**
      * @brief Convenient template method to pop messages.
      *
@@ -170,6 +435,27 @@ public:
         return ret;
     }
 
+    /**
+     * @brief Convenient template method to evict messages, see @ref popT.
+     *
+     * @copydetails evict(Message& message, Evictable evictable)
+     */
+    template<typename Derived>
+    std::size_t
+    evictT(std::shared_ptr<Derived> &message, Evictable evictable = nullptr)
+    {
+        Message abstract_message;
+        std::size_t ret = evict(abstract_message, evictable);
+        if (ret > 0)
+        {
+            assert(abstract_message.get() != nullptr);
+            message = std::dynamic_pointer_cast<Derived>(abstract_message);
+            assert(message.get() == abstract_message.get());
+        }
+
+        return ret;
+    }
+
 };
 
 
@@ -202,9 +488,14 @@ public:
      * @param max_capacity Maximum number of messages that can be queued at
      *        the same time. By default this limit is relaxed as much as
      *        possible.
+     *
+     * @param wait_strategy How a blocking @ref pop polls the queue before
+     *        parking the calling thread. By default it parks immediately.
      */
     explicit inline MessageQueueT(std::size_t max_capacity
-                                     = std::numeric_limits<std::size_t>::max());
+                                     = std::numeric_limits<std::size_t>::max(),
+                                  const WaitStrategy &wait_strategy
+                                     = WaitStrategy());
 
     /**
      * @brief Pops one message from the queue.
@@ -214,7 +505,8 @@ public:
      *
      * @param block If set to @a true the method blocks the current thread
      *        indefinitely until a new message is pushed into the queue
-     *        by another thread or until the queue is not cancelled.
+     *        by another thread or until the queue is cancelled or closed
+     *        and empty.
      *
      * @return
      * - On failure, @a zero (parameter message is not touched in that case).
@@ -242,6 +534,19 @@ public:
      */
     inline std::size_t push(const M &message);
 
+    /**
+     * @brief Pushes one message into the queue ahead of the messages pushed
+     * by @ref push, ordered by a key (see @ref IMessageQueue::push_ordered).
+     *
+     * @param message The message to be inserted.
+     *
+     * @param key The ordering key of the message, the lowest is popped
+     *        first.
+     *
+     * @return The same as @ref push.
+     */
+    inline std::size_t push_ordered(const M &message, std::uint64_t key);
+
     /**
      * @copydoc IMessageQueue::cancel()
      */
@@ -252,11 +557,47 @@ public:
      */
     inline bool is_cancelled() const;
 
+    /**
+     * @copydoc IMessageQueue::close()
+     */
+    inline void close();
+
+    /**
+     * @copydoc IMessageQueue::is_closed()
+     */
+    inline bool is_closed() const;
+
     /**
      * @copydoc IMessageQueue::size()
      */
     inline std::size_t size() const;
 
+    /**
+     * @copydoc IMessageQueue::stats()
+     */
+    inline void stats(MessageQueueStats &dst) const;
+
+    /**
+     * @brief Returns the abstract interface used by the template, for
+     * instance to wait for it together with other queues (see @ref
+     * Selector).
+     *
+     * @note The messages of the queue are not meant to be popped out of the
+     * template (they are wrapped into a private implementation of @ref
+     * IMessage).
+     */
+    inline IMessageQueue &interface();
+
+    /**
+     * @brief Extracts the payload of a message popped from the interface of
+     * the template (see method @ref interface).
+     *
+     * @param message A message popped from the interface of this queue.
+     *
+     * @return The payload pushed by the producer.
+     */
+    static inline const M &payload(const Message &message);
+
 private:
 
     std::shared_ptr<IMessageQueue> m_impl;
@@ -285,8 +626,9 @@ private:
 // ----------------------------------------------------------------------------
 
 template<typename M>
-MessageQueueT<M>::MessageQueueT(std::size_t max_capacity)
-        : m_impl(IMessageQueue::create(max_capacity))
+MessageQueueT<M>::MessageQueueT(std::size_t max_capacity,
+                                const WaitStrategy &wait_strategy)
+        : m_impl(IMessageQueue::create(max_capacity, wait_strategy))
 {
 }
 
@@ -301,14 +643,7 @@ MessageQueueT<M>::pop(M &dst_message, bool blocking)
 
     if (ret > 0)
     {
-        assert(nullptr != abstract_message.get());
-
-        typedef MessageImpl<M> Implementation;
-        auto message =
-                std::dynamic_pointer_cast<Implementation>(abstract_message);
-        assert(message.get() == abstract_message.get());
-
-        dst_message = message->m_payload;
+        dst_message = payload(abstract_message);
     }
 
     return ret;
@@ -327,6 +662,17 @@ MessageQueueT<M>::push(const M &message)
 
 // ----------------------------------------------------------------------------
 
+template<typename M>
+std::size_t
+MessageQueueT<M>::push_ordered(const M &message, std::uint64_t key)
+{
+    Message new_message(new MessageImpl<M>(message));
+
+    return m_impl->push_ordered(new_message, key, false);
+}
+
+// ----------------------------------------------------------------------------
+
 template<typename M>
 void
 MessageQueueT<M>::cancel()
@@ -345,6 +691,24 @@ MessageQueueT<M>::is_cancelled() const
 
 // ----------------------------------------------------------------------------
 
+template<typename M>
+void
+MessageQueueT<M>::close()
+{
+    m_impl->close();
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename M>
+bool
+MessageQueueT<M>::is_closed() const
+{
+    return m_impl->is_closed();
+}
+
+// ----------------------------------------------------------------------------
+
 template<typename M>
 std::size_t
 MessageQueueT<M>::size() const
@@ -352,4 +716,38 @@ MessageQueueT<M>::size() const
     return m_impl->size();
 }
 
+// ----------------------------------------------------------------------------
+
+template<typename M>
+void
+MessageQueueT<M>::stats(MessageQueueStats &dst) const
+{
+    m_impl->stats(dst);
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename M>
+IMessageQueue &
+MessageQueueT<M>::interface()
+{
+    return *m_impl;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename M>
+const M &
+MessageQueueT<M>::payload(const Message &abstract_message)
+{
+    assert(nullptr != abstract_message.get());
+
+    typedef MessageImpl<M> Implementation;
+    auto message =
+            dynamic_cast<const Implementation *>(abstract_message.get());
+    assert(nullptr != message);
+
+    return message->m_payload;
+}
+
 #endif // MESSAGEQUEUE_H
@@ -29,6 +29,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "Mutex.h"
 
+#include "Clock.h"
+#include "MutexProfile.h"
+
 // ------------------------------------------------------------------------
 
 #include <pthread.h>
@@ -39,7 +42,9 @@ class MutexPosixImpl
 
 public:
 
-    MutexPosixImpl()
+    MutexPosixImpl(MutexProfileStats *stats)
+            : m_stats(stats),
+              m_acquired_ns(0)
     {
         ::pthread_mutex_init(&m_mutex, nullptr);
     }
@@ -53,12 +58,27 @@ public:
     virtual void
     lock()
     {
-        ::pthread_mutex_lock(&m_mutex);
+        if (MutexProfileStats::is_active() && m_stats != nullptr)
+        {
+            lock_profiled();
+        }
+        else
+        {
+            ::pthread_mutex_lock(&m_mutex);
+        }
     }
 
     virtual void
     unlock()
     {
+        // Set only by the profiled acquisitions, so that switching the
+        // profiling while the mutex is owned is harmless:
+        if (m_acquired_ns != 0)
+        {
+            m_stats->record_hold(clock_now_ns() - m_acquired_ns);
+            m_acquired_ns = 0;
+        }
+
         ::pthread_mutex_unlock(&m_mutex);
     }
 
@@ -70,7 +90,27 @@ public:
 
 private:
 
+    void
+    lock_profiled()
+    {
+        // Tries first without blocking to detect the contention:
+        if (::pthread_mutex_trylock(&m_mutex) == 0)
+        {
+            m_stats->record_acquisition(false, 0);
+        }
+        else
+        {
+            std::uint64_t begin = clock_now_ns();
+            ::pthread_mutex_lock(&m_mutex);
+            m_stats->record_acquisition(true, clock_now_ns() - begin);
+        }
+
+        m_acquired_ns = clock_now_ns();
+    }
+
     pthread_mutex_t m_mutex;
+    MutexProfileStats *m_stats;
+    std::uint64_t m_acquired_ns;
 
 };
 
@@ -79,7 +119,15 @@ private:
 IMutex *
 IMutex::create()
 {
-    return new MutexPosixImpl();
+    return new MutexPosixImpl(nullptr);
+}
+
+// -----------------------------------------------------------------------------
+
+IMutex *
+IMutex::create(const char *name)
+{
+    return new MutexPosixImpl(MutexProfileStats::lookup(name));
 }
 
 // -----------------------------------------------------------------------------
@@ -57,6 +57,19 @@ public:
      */
     static IMutex *create();
 
+    /**
+     * @brief Creates one new mutex that can be profiled.
+     *
+     * While the profiling is active (see @ref mutex_profile_set) every
+     * acquisition and release of the mutex is accounted into statistics
+     * shared by all the mutexes created with the same name (see @ref
+     * MutexProfileStats). When the profiling is not active the mutex behaves
+     * exactly as one returned by @ref create().
+     *
+     * @param name Name used to group the statistics, it's copied.
+     */
+    static IMutex *create(const char *name);
+
     /**
      * @brief Destructor.
      */
@@ -114,7 +127,7 @@ public:
      *
      * @ingroup threading-base
      */
-    typedef Locker<Mutex> Locker;
+    typedef ::Locker<Mutex> Locker;
 
     /**
      * @brief Default constructor.
@@ -141,6 +154,18 @@ public:
         assert(nullptr != m_mutex.get());
     }
 
+    /**
+     * @brief Builds a named mutex calling the method @ref
+     * IMutex::create(const char *) and hosting the returned abstract
+     * interface.
+     *
+     * @param name Name used to group the profiling statistics.
+     */
+    explicit Mutex(const char *name)
+            : m_mutex(IMutex::create(name))
+    {
+    }
+
     /**
      * @copydoc IMutex::lock()
      */
@@ -0,0 +1,166 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "MutexProfile.h"
+
+#include "Mutex.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <memory>
+
+// -----------------------------------------------------------------------------
+
+std::atomic<bool> MutexProfileStats::s_active(false);
+
+namespace
+{
+
+typedef std::map<std::string, std::unique_ptr<MutexProfileStats> > Registry;
+
+// Anonymous mutexes are never profiled, so the registry can be protected by
+// one of them without recursion.
+struct RegistryData
+{
+    Mutex m_mutex;
+    Registry m_registry;
+};
+
+RegistryData &
+registry_data()
+{
+    static RegistryData data;
+    return data;
+}
+
+bool
+compare_wait(const MutexProfileEntry &a, const MutexProfileEntry &b)
+{
+    return a.wait_ns > b.wait_ns;
+}
+
+} // anonymous namespace
+
+// -----------------------------------------------------------------------------
+
+MutexProfileStats *
+MutexProfileStats::lookup(const char *name)
+{
+    assert(name != nullptr);
+
+    RegistryData &data = registry_data();
+    Locker<Mutex> locker(data.m_mutex);
+
+    std::unique_ptr<MutexProfileStats> &stats = data.m_registry[name];
+    if (!stats)
+    {
+        stats.reset(new MutexProfileStats(name));
+    }
+
+    return stats.get();
+}
+
+// -----------------------------------------------------------------------------
+
+void
+mutex_profile_set(bool active)
+{
+    MutexProfileStats::set_active(active);
+}
+
+// -----------------------------------------------------------------------------
+
+void
+mutex_profile_reset()
+{
+    RegistryData &data = registry_data();
+    Locker<Mutex> locker(data.m_mutex);
+
+    for (auto &item: data.m_registry)
+    {
+        item.second->reset();
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void
+mutex_profile_snapshot(std::vector<MutexProfileEntry> &entries)
+{
+    RegistryData &data = registry_data();
+    Locker<Mutex> locker(data.m_mutex);
+
+    entries.resize(data.m_registry.size());
+
+    std::size_t i = 0;
+    for (auto &item: data.m_registry)
+    {
+        item.second->snapshot(entries[i++]);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void
+mutex_profile_report(std::ostream &stream)
+{
+    std::vector<MutexProfileEntry> entries;
+    mutex_profile_snapshot(entries);
+    std::sort(entries.begin(), entries.end(), compare_wait);
+
+    stream << std::left << std::setw(24) << "mutex"
+           << std::right
+           << std::setw(12) << "acquired"
+           << std::setw(12) << "contended"
+           << std::setw(14) << "wait_ns"
+           << std::setw(12) << "wait_p50"
+           << std::setw(12) << "wait_p99"
+           << std::setw(12) << "hold_p50"
+           << std::setw(12) << "hold_p99"
+           << std::setw(12) << "hold_max"
+           << "\n";
+
+    for (auto &entry: entries)
+    {
+        stream << std::left << std::setw(24) << entry.name
+               << std::right
+               << std::setw(12) << entry.acquisitions
+               << std::setw(12) << entry.contentions
+               << std::setw(14) << entry.wait_ns
+               << std::setw(12) << entry.wait.percentile(50.0)
+               << std::setw(12) << entry.wait.percentile(99.0)
+               << std::setw(12) << entry.hold.percentile(50.0)
+               << std::setw(12) << entry.hold.percentile(99.0)
+               << std::setw(12) << entry.hold.max
+               << "\n";
+    }
+}
+
+// -----------------------------------------------------------------------------
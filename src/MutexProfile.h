@@ -0,0 +1,248 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MUTEXPROFILE_H
+#define MUTEXPROFILE_H
+
+#include "Histogram.h"
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Contention statistics of all the mutexes sharing one name.
+ *
+ * @ingroup threading-base
+ */
+struct MutexProfileEntry
+{
+    /**
+     * @brief The name passed to @ref IMutex::create(const char *).
+     */
+    std::string name;
+
+    /**
+     * @brief Number of times the mutexes have been locked.
+     */
+    std::uint64_t acquisitions;
+
+    /**
+     * @brief Number of times the mutexes were already owned by another
+     * thread when a lock was requested.
+     */
+    std::uint64_t contentions;
+
+    /**
+     * @brief Cumulative time spent waiting for the contended acquisitions.
+     */
+    std::uint64_t wait_ns;
+
+    /**
+     * @brief Distribution of the waiting times (nanoseconds) of contended
+     * acquisitions.
+     */
+    HistogramSnapshot wait;
+
+    /**
+     * @brief Distribution of the holding times (nanoseconds).
+     *
+     * @note Since @ref ICond::wait releases and acquires back the mutex
+     * without calling @ref IMutex::unlock and @ref IMutex::lock, holding
+     * times of mutexes used with condition variables are approximate.
+     */
+    HistogramSnapshot hold;
+
+    MutexProfileEntry()
+            : acquisitions(0),
+              contentions(0),
+              wait_ns(0)
+    {
+    }
+};
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Contention counters shared by all the mutexes created with the same
+ * name (see @ref IMutex::create(const char *)).
+ *
+ * The counters are only updated while the profiling is active (see @ref
+ * mutex_profile_set), otherwise locking a named mutex costs one single extra
+ * branch over an anonymous one.
+ *
+ * @ingroup threading-base
+ */
+class MutexProfileStats
+{
+
+public:
+
+    /**
+     * @brief Returns the statistics object associated to the passed name,
+     * creating it the first time the name is used.
+     *
+     * The returned object is never destroyed.
+     */
+    static MutexProfileStats *lookup(const char *name);
+
+    /**
+     * @brief Returns @a true if the mutexes are currently profiled.
+     */
+    static bool
+    is_active()
+    {
+        return s_active.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Starts or stops the profiling of all the named mutexes.
+     */
+    static void
+    set_active(bool active)
+    {
+        s_active.store(active, std::memory_order_relaxed);
+    }
+
+    explicit MutexProfileStats(const char *name)
+            : m_name(name),
+              m_acquisitions(0),
+              m_contentions(0),
+              m_wait_ns(0)
+    {
+    }
+
+    /**
+     * @brief Records one acquisition of a mutex.
+     *
+     * @param contended @a true if the mutex was owned by another thread.
+     * @param wait_ns Time spent waiting for the ownership.
+     */
+    void
+    record_acquisition(bool contended, std::uint64_t wait_ns)
+    {
+        m_acquisitions.fetch_add(1, std::memory_order_relaxed);
+        if (contended)
+        {
+            m_contentions.fetch_add(1, std::memory_order_relaxed);
+            m_wait_ns.fetch_add(wait_ns, std::memory_order_relaxed);
+            m_wait.record(wait_ns);
+        }
+    }
+
+    /**
+     * @brief Records for how long a mutex has been owned before its release.
+     */
+    void
+    record_hold(std::uint64_t hold_ns)
+    {
+        m_hold.record(hold_ns);
+    }
+
+    /**
+     * @brief Copies the collected statistics.
+     */
+    void
+    snapshot(MutexProfileEntry &entry) const
+    {
+        entry.name = m_name;
+        entry.acquisitions = m_acquisitions.load(std::memory_order_relaxed);
+        entry.contentions = m_contentions.load(std::memory_order_relaxed);
+        entry.wait_ns = m_wait_ns.load(std::memory_order_relaxed);
+        m_wait.snapshot(entry.wait);
+        m_hold.snapshot(entry.hold);
+    }
+
+    /**
+     * @brief Discards the collected statistics.
+     */
+    void
+    reset()
+    {
+        m_acquisitions.store(0, std::memory_order_relaxed);
+        m_contentions.store(0, std::memory_order_relaxed);
+        m_wait_ns.store(0, std::memory_order_relaxed);
+        m_wait.reset();
+        m_hold.reset();
+    }
+
+private:
+
+    static std::atomic<bool> s_active;
+
+    const std::string m_name;
+    std::atomic<std::uint64_t> m_acquisitions;
+    std::atomic<std::uint64_t> m_contentions;
+    std::atomic<std::uint64_t> m_wait_ns;
+    Histogram m_wait;
+    Histogram m_hold;
+
+    MutexProfileStats(const MutexProfileStats &);
+    MutexProfileStats &operator=(const MutexProfileStats &);
+
+};
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Starts or stops the profiling of all the named mutexes.
+ *
+ * @ingroup threading-base
+ */
+void mutex_profile_set(bool active);
+
+/**
+ * @brief Discards the statistics collected so far.
+ *
+ * @ingroup threading-base
+ */
+void mutex_profile_reset();
+
+/**
+ * @brief Copies the statistics collected so far, one entry per mutex name.
+ *
+ * @ingroup threading-base
+ */
+void mutex_profile_snapshot(std::vector<MutexProfileEntry> &entries);
+
+/**
+ * @brief Writes a human readable table of the statistics collected so far,
+ * sorted by cumulative waiting time.
+ *
+ * @ingroup threading-base
+ */
+void mutex_profile_report(std::ostream &stream);
+
+// -----------------------------------------------------------------------------
+
+#endif // MUTEXPROFILE_H
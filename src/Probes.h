@@ -0,0 +1,85 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PROBES_H
+#define PROBES_H
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @file Probes.h
+ *
+ * @brief Static tracing points (USDT) on the hot paths of the library.
+ *
+ * When the library is built with the CMake option TP_ENABLE_USDT the probes
+ * are compiled through the header-only @a sys/sdt.h (systemtap-sdt-dev) as
+ * one single @a nop instruction plus an ELF note describing the location and
+ * the arguments of the probe: tools like perf, bpftrace or SystemTap can
+ * attach to them in a running process, e.g.:
+ *
+ * @code
+   bpftrace -e 'usdt:./tp-ut:rr_thread_pool:task__finish { @[arg1] = count(); }'
+   @endcode
+ *
+ * Otherwise they expand to nothing.
+ *
+ * Provider @a rr_thread_pool, probes and arguments:
+ * - @a queue__push (queue, size after the insertion or 0 on failure).
+ * - @a queue__pop (queue, size before the extraction or 0 on failure).
+ * - @a queue__wait__start (queue), @a queue__wait__done (queue): blocking
+ *   pop waiting for a message.
+ * - @a task__start (task, worker index), @a task__finish (task, worker
+ *   index): execution of a task by a thread pool worker.
+ * - @a thread__create (pthread handle), @a thread__join__start (pthread
+ *   handle), @a thread__join__done (pthread handle).
+ *
+ * @ingroup threading-base
+ */
+
+#if defined(TP_ENABLE_USDT)
+
+#include <sys/sdt.h>
+
+#define TP_PROBE1(name, arg1) \
+    DTRACE_PROBE1(rr_thread_pool, name, arg1)
+
+#define TP_PROBE2(name, arg1, arg2) \
+    DTRACE_PROBE2(rr_thread_pool, name, arg1, arg2)
+
+#else
+
+#define TP_PROBE1(name, arg1) do { } while (false)
+
+#define TP_PROBE2(name, arg1, arg2) do { } while (false)
+
+#endif
+
+// -----------------------------------------------------------------------------
+
+#endif // PROBES_H
@@ -0,0 +1,175 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Selector.h"
+
+#include <limits>
+
+// -----------------------------------------------------------------------------
+
+const std::size_t Selector::NONE = std::numeric_limits<std::size_t>::max();
+
+// -----------------------------------------------------------------------------
+
+Selector::Selector()
+        :
+        m_next(0)
+{
+}
+
+// -----------------------------------------------------------------------------
+
+Selector::~Selector()
+{
+    for (auto queue: m_queues)
+    {
+        queue->remove_listener(this);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+std::size_t
+Selector::add(IMessageQueue &queue)
+{
+    m_queues.push_back(&queue);
+    queue.add_listener(this);
+
+    return m_queues.size() - 1;
+}
+
+// -----------------------------------------------------------------------------
+
+std::size_t
+Selector::size() const
+{
+    return m_queues.size();
+}
+
+// -----------------------------------------------------------------------------
+
+IMessageQueue &
+Selector::queue(std::size_t index)
+{
+    assert(index < m_queues.size());
+
+    return *m_queues[index];
+}
+
+// -----------------------------------------------------------------------------
+
+std::size_t
+Selector::select(bool blocking)
+{
+    bool finished = false;
+
+    std::size_t ret = scan(finished);
+    while (blocking && NONE == ret && !finished)
+    {
+        // Scans again after announcing the wait, so that a queue becoming
+        // ready in the meanwhile wakes up the wait immediately:
+        EventCount::Key key = m_event_count.prepare_wait();
+
+        ret = scan(finished);
+        if (NONE != ret || finished)
+        {
+            m_event_count.cancel_wait();
+            break;
+        }
+
+        m_event_count.wait(key);
+        ret = scan(finished);
+    }
+
+    return ret;
+}
+
+// -----------------------------------------------------------------------------
+
+std::size_t
+Selector::pop(Message &message, std::size_t &index, bool blocking)
+{
+    for (;;)
+    {
+        std::size_t selected = select(blocking);
+        if (NONE == selected)
+        {
+            return 0;
+        }
+
+        // Another consumer of the same queue may have been faster:
+        std::size_t ret = m_queues[selected]->pop(message, false);
+        if (ret > 0)
+        {
+            index = selected;
+            return ret;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void
+Selector::on_ready(IMessageQueue &queue)
+{
+    (void) queue;
+
+    m_event_count.notify();
+}
+
+// -----------------------------------------------------------------------------
+
+std::size_t
+Selector::scan(bool &finished)
+{
+    const std::size_t count = m_queues.size();
+
+    finished = true;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        std::size_t index = (m_next + i) % count;
+        IMessageQueue *queue = m_queues[index];
+
+        if (queue->size() > 0)
+        {
+            m_next = index + 1;
+            finished = false;
+            return index;
+        }
+
+        if (!queue->is_cancelled() && !queue->is_closed())
+        {
+            finished = false;
+        }
+    }
+
+    return NONE;
+}
+
+// -----------------------------------------------------------------------------
@@ -0,0 +1,163 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SELECTOR_H
+#define SELECTOR_H
+
+#include "EventCount.h"
+#include "MessageQueue.h"
+
+#include <cstddef>
+#include <vector>
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief Waits for any of a set of message queues to become ready.
+ *
+ * The selector registers itself as a listener of every added queue (see
+ * @ref IMessageQueue::add_listener) and sleeps on one shared @ref EventCount
+ * that the queues notify when they turn non empty, so a single thread can
+ * serve many queues without polling them and without one thread for each
+ * queue.
+ *
+ * Example:
+ * @code
+   Selector selector;
+   selector.add(control_queue);
+   selector.add(data_queue.interface());
+
+   Message message;
+   std::size_t index;
+   while (selector.pop(message, index, true))
+   {
+       ...
+   }
+ * @endcode
+ *
+ * @note
+ * - The queues must outlive the selector.
+ * - The selector is meant to be used by one thread at a time, while the
+ *   queues may be used by any other thread as usual.
+ *
+ * @ingroup threading-high
+ */
+class Selector
+        : private IMessageQueueListener
+{
+
+public:
+
+    /**
+     * @brief Index returned when no queue is ready.
+     */
+    static const std::size_t NONE;
+
+    /**
+     * @brief Constructor.
+     */
+    Selector();
+
+    /**
+     * @brief Destructor, unregisters the selector from the queues.
+     */
+    virtual ~Selector();
+
+    /**
+     * @brief Adds one queue to the set.
+     *
+     * @param queue The queue to be watched.
+     *
+     * @return The index identifying the queue into the set.
+     */
+    std::size_t add(IMessageQueue &queue);
+
+    /**
+     * @brief Returns the number of queues of the set.
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief Returns the queue with the given index.
+     */
+    IMessageQueue &queue(std::size_t index);
+
+    /**
+     * @brief Looks for a queue containing at least one message.
+     *
+     * Queues are scanned in round robin starting after the last selected
+     * one, so a busy queue can't starve the others.
+     *
+     * @param blocking If set to @a true the method blocks the current thread
+     *        indefinitely until a message is pushed into any of the queues
+     *        or until every queue is cancelled, or closed and empty.
+     *
+     * @return The index of a non empty queue or @ref NONE if there isn't
+     *         any (or if no queue can receive messages any more).
+     */
+    std::size_t select(bool blocking);
+
+    /**
+     * @brief Pops one message from any of the queues.
+     *
+     * @param[out] message Smart pointer that will be reset with the popped
+     *             message in case of success.
+     *
+     * @param[out] index Set to the index of the queue the message comes from
+     *             in case of success.
+     *
+     * @param blocking See method @ref select.
+     *
+     * @return
+     * - On success, the number of messages contained by the selected queue
+     *   before the extraction, that is at least @a one.
+     * - On failure, @a zero (parameters are not touched in that case).
+     */
+    std::size_t pop(Message &message, std::size_t &index, bool blocking);
+
+private:
+
+    Selector(const Selector &);
+    Selector &operator=(const Selector &);
+
+    virtual void on_ready(IMessageQueue &queue);
+
+    // Returns the index of a non empty queue or NONE, sets finished if every
+    // queue is done:
+    std::size_t scan(bool &finished);
+
+    std::vector<IMessageQueue *> m_queues;
+    std::size_t m_next;
+    EventCount m_event_count;
+
+};
+
+// ----------------------------------------------------------------------------
+
+#endif // SELECTOR_H
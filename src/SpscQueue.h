@@ -0,0 +1,423 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include "Cond.h"
+#include "Mutex.h"
+#include "WaitStrategy.h"
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <assert.h>
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief Bounded message queue for one producer thread and one consumer
+ * thread.
+ *
+ * This class offers the same interface of @ref MessageQueueT but trades the
+ * generality of @ref IMessageQueue for speed: messages are stored by value
+ * into a ring buffer whose indices are exchanged between the two threads
+ * with acquire/release atomics, so @ref push and the non blocking @ref pop
+ * are wait-free and don't take any lock.
+ *
+ * The head (written by the consumer) and the tail (written by the producer)
+ * live on distinct cache lines, and each thread keeps a private copy of the
+ * index owned by its peer that is refreshed only when the queue looks full
+ * (or empty), so in the common case the two threads don't share any cache
+ * line apart from the messages themselves.
+ *
+ * A blocking @ref pop polls for a while (see @ref WaitStrategy) and then
+ * parks the consumer on a condition variable; the producer takes the mutex
+ * only when the consumer is actually parked.
+ *
+ * @tparam M Type of the messages: must be default constructible and
+ *         copyable (or movable).
+ *
+ * @note
+ * - At any time at most one thread may call @ref push and at most one
+ *   (other) thread may call @ref pop; the other methods can be called by
+ *   any thread.
+ * - The capacity is rounded up to the next power of two.
+ *
+ * @ingroup threading-high
+ */
+template<typename M>
+class SpscQueueT
+{
+
+public:
+
+    /**
+     * @brief Constructor.
+     *
+     * @param max_capacity Maximum number of messages that can be queued at
+     *        the same time, rounded up to the next power of two.
+     *
+     * @param wait_strategy How a blocking @ref pop polls the queue before
+     *        parking the consumer. By default it yields the processor a few
+     *        times.
+     *
+     * @pre
+     * - Parameter @a max_capacity is greater than zero.
+     */
+    explicit inline SpscQueueT(std::size_t max_capacity,
+                               const WaitStrategy &wait_strategy
+                                   = WaitStrategy(0, 0, YIELD_COUNT));
+
+    /**
+     * @brief Pops one message from the queue.
+     *
+     * @param[out] dst_message A reference to a message object meant to be set
+     *             with the extracted message only in case of success.
+     *
+     * @param block If set to @a true the method blocks the current thread
+     *        indefinitely until a new message is pushed into the queue
+     *        by the producer or until the queue is cancelled or closed and
+     *        empty.
+     *
+     * @return
+     * - On failure, @a zero (parameter message is not touched in that case).
+     * - On success, the number of messages contained by the queue before the
+     *   extraction that is at least @a one.
+     *
+     * @pre
+     * - Called only by the consumer thread.
+     */
+    inline std::size_t pop(M &dst_message, bool block);
+
+    /**
+     * @brief Pushes one message into the queue.
+     *
+     * @param message The message to be inserted.
+     *
+     * @return
+     * - On failure, @a zero. This happens if the queue is full or closed.
+     * - On success, the number of messages contained by the queue after the
+     *   insertion that is at least @a one.
+     *
+     * @pre
+     * - Called only by the producer thread.
+     */
+    inline std::size_t push(const M &message);
+
+    /**
+     * @copydoc IMessageQueue::cancel()
+     */
+    inline void cancel();
+
+    /**
+     * @copydoc IMessageQueue::is_cancelled()
+     */
+    inline bool is_cancelled() const;
+
+    /**
+     * @copydoc IMessageQueue::close()
+     */
+    inline void close();
+
+    /**
+     * @copydoc IMessageQueue::is_closed()
+     */
+    inline bool is_closed() const;
+
+    /**
+     * @copydoc IMessageQueue::size()
+     */
+    inline std::size_t size() const;
+
+    /**
+     * @brief Returns the maximum number of messages that can be queued.
+     */
+    inline std::size_t capacity() const;
+
+private:
+
+    typedef ::Locker<Mutex> Locker;
+
+    enum
+    {
+        CACHE_LINE_SIZE = 64,
+
+        // Default number of polls of a blocking pop before parking the
+        // consumer:
+        YIELD_COUNT = 128
+    };
+
+    static inline std::size_t round_up(std::size_t value);
+
+    inline bool wait(std::size_t head);
+
+    // Read-only after construction:
+    const std::size_t m_mask;
+    std::vector<M> m_slots;
+    const WaitStrategy m_wait_strategy;
+
+    char m_padding0[CACHE_LINE_SIZE];
+
+    // Owned by the consumer:
+    std::atomic<std::size_t> m_head;
+    std::size_t m_cached_tail;
+
+    char m_padding1[CACHE_LINE_SIZE];
+
+    // Owned by the producer:
+    std::atomic<std::size_t> m_tail;
+    std::size_t m_cached_head;
+
+    char m_padding2[CACHE_LINE_SIZE];
+
+    // Shared, touched only by blocking pops, by cancel and by close:
+    std::atomic<bool> m_cancelled;
+    std::atomic<bool> m_closed;
+    std::atomic<bool> m_waiting;
+    Mutex m_mutex;
+    Cond m_cond;
+
+};
+
+// ----------------------------------------------------------------------------
+
+template<typename M>
+SpscQueueT<M>::SpscQueueT(std::size_t max_capacity,
+                          const WaitStrategy &wait_strategy)
+        : m_mask(round_up(max_capacity) - 1),
+          m_slots(m_mask + 1),
+          m_wait_strategy(wait_strategy),
+          m_head(0),
+          m_cached_tail(0),
+          m_tail(0),
+          m_cached_head(0),
+          m_cancelled(false),
+          m_closed(false),
+          m_waiting(false),
+          m_mutex("SpscQueue")
+{
+    assert(max_capacity > 0);
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename M>
+std::size_t
+SpscQueueT<M>::pop(M &dst_message, bool block)
+{
+    const std::size_t head = m_head.load(std::memory_order_relaxed);
+
+    if (head == m_cached_tail)
+    {
+        m_cached_tail = m_tail.load(std::memory_order_acquire);
+        if (head == m_cached_tail && (!block || !wait(head)))
+        {
+            return 0;
+        }
+    }
+
+    std::size_t ret = m_cached_tail - head;
+
+    M &slot = m_slots[head & m_mask];
+    dst_message = std::move(slot);
+    slot = M(); // Releases any resource held by the moved-from message.
+
+    m_head.store(head + 1, std::memory_order_release);
+
+    return ret;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename M>
+std::size_t
+SpscQueueT<M>::push(const M &message)
+{
+    const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+
+    if (m_closed.load(std::memory_order_relaxed))
+    {
+        return 0;
+    }
+
+    if (tail - m_cached_head > m_mask)
+    {
+        m_cached_head = m_head.load(std::memory_order_acquire);
+        if (tail - m_cached_head > m_mask)
+        {
+            return 0; // Full.
+        }
+    }
+
+    m_slots[tail & m_mask] = message;
+    m_tail.store(tail + 1, std::memory_order_release);
+
+    // Pairs with the fence into wait(): either the consumer sees the new tail
+    // or the producer sees the consumer parking.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_waiting.load(std::memory_order_relaxed))
+    {
+        Locker locker(m_mutex);
+        m_cond.signal();
+    }
+
+    return tail + 1 - m_cached_head;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename M>
+void
+SpscQueueT<M>::cancel()
+{
+    Locker locker(m_mutex);
+    m_cancelled.store(true);
+    m_cond.broadcast();
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename M>
+bool
+SpscQueueT<M>::is_cancelled() const
+{
+    return m_cancelled.load();
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename M>
+void
+SpscQueueT<M>::close()
+{
+    Locker locker(m_mutex);
+    m_closed.store(true);
+    m_cond.broadcast();
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename M>
+bool
+SpscQueueT<M>::is_closed() const
+{
+    return m_closed.load();
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename M>
+std::size_t
+SpscQueueT<M>::size() const
+{
+    // Head first: the tail read afterwards can't be behind it.
+    std::size_t head = m_head.load(std::memory_order_acquire);
+    std::size_t tail = m_tail.load(std::memory_order_acquire);
+
+    return tail - head;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename M>
+std::size_t
+SpscQueueT<M>::capacity() const
+{
+    return m_mask + 1;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename M>
+std::size_t
+SpscQueueT<M>::round_up(std::size_t value)
+{
+    std::size_t ret = 1;
+    while (ret < value)
+    {
+        ret <<= 1;
+    }
+
+    return ret;
+}
+
+// ----------------------------------------------------------------------------
+
+// Waits until the tail moves past the given head, returns false if the queue
+// gets cancelled, or closed and drained, first.
+template<typename M>
+bool
+SpscQueueT<M>::wait(std::size_t head)
+{
+    bool polled = m_wait_strategy.poll([this, head]()
+    {
+        // The closed flag is read before the tail, so that the messages
+        // pushed before closing are never missed:
+        bool closed = m_closed.load(std::memory_order_acquire);
+        m_cached_tail = m_tail.load(std::memory_order_acquire);
+        return head != m_cached_tail
+                || closed
+                || m_cancelled.load(std::memory_order_relaxed);
+    });
+
+    if (polled)
+    {
+        return head != m_cached_tail
+                && !m_cancelled.load(std::memory_order_relaxed);
+    }
+
+    Locker locker(m_mutex);
+
+    m_waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // The producer signals while holding the mutex, so it can't slip in
+    // between the check and the wait:
+    while (!m_cancelled.load(std::memory_order_relaxed))
+    {
+        bool closed = m_closed.load(std::memory_order_acquire);
+        m_cached_tail = m_tail.load(std::memory_order_acquire);
+        if (head != m_cached_tail || closed)
+        {
+            break;
+        }
+
+        m_cond.wait(m_mutex); // Performs unlock-wait-lock op.
+    }
+
+    m_waiting.store(false, std::memory_order_relaxed);
+
+    return head != m_cached_tail
+            && !m_cancelled.load(std::memory_order_relaxed);
+}
+
+#endif // SPSCQUEUE_H
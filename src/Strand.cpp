@@ -0,0 +1,91 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Strand.h"
+
+// -----------------------------------------------------------------------------
+
+class StrandMessage
+        :
+                public IMailboxMessage
+{
+
+public:
+
+    Task m_task;
+
+    explicit StrandMessage(Task task)
+            : m_task(task)
+    {
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+Strand::Strand(IThreadPool &pool, std::size_t batch)
+        :
+        Actor(pool, batch)
+{
+}
+
+// -----------------------------------------------------------------------------
+
+Strand::~Strand()
+{
+}
+
+// -----------------------------------------------------------------------------
+
+void
+Strand::post(Task task)
+{
+    assert(nullptr != task.get());
+
+    send(std::make_shared<StrandMessage>(task));
+}
+
+// -----------------------------------------------------------------------------
+
+void
+Strand::receive(MailboxMessage message)
+{
+    // Same treatment the workers of the pool give to their tasks:
+    ITask::run(*static_cast<StrandMessage &>(*message).m_task);
+}
+
+// -----------------------------------------------------------------------------
+
+void
+Strand::discard(MailboxMessage message)
+{
+    ITask::run_cancel(*static_cast<StrandMessage &>(*message).m_task);
+}
+
+// -----------------------------------------------------------------------------
@@ -0,0 +1,278 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef STRAND_H
+#define STRAND_H
+
+#include "Actor.h"
+#include "Mutex.h"
+#include "Task.h"
+#include "ThreadPool.h"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief Serial executor: runs its tasks one at a time in FIFO order on the
+ * threads of a pool.
+ *
+ * Tasks posted to the same strand never run concurrently with each other,
+ * so they can share state without locking it, while tasks posted to
+ * different strands run in parallel on any worker of the pool. No thread is
+ * dedicated to a strand: the strand is an @ref Actor whose messages are the
+ * tasks themselves.
+ *
+ * Like the tasks posted to the pool (see @ref IThreadPool::post), the tasks
+ * of a strand are not collected after their execution; an exception thrown
+ * by a task is attached to it (see @ref ITask::has_failed) and a cancelled
+ * task (see @ref ITask::is_cancelled) is skipped and notified through @ref
+ * ITask::cancel.
+ *
+ * @note
+ * - Method @ref post is thread safe.
+ * - The same notes of @ref Actor about the pool and the lifetime apply.
+ * - Once the pool is shut down the tasks left into the strand are
+ *   cancelled (see @ref ITask::cancel).
+ *
+ * @ingroup threading-high
+ */
+class Strand
+        : public Actor
+{
+
+public:
+
+    /**
+     * @brief Constructor.
+     *
+     * @param pool The thread pool executing the tasks.
+     *
+     * @param batch Maximum number of tasks executed before giving the thread
+     *        back to the pool.
+     */
+    explicit Strand(IThreadPool &pool, std::size_t batch = DEFAULT_BATCH);
+
+    /**
+     * @brief Destructor.
+     */
+    virtual ~Strand();
+
+    /**
+     * @brief Submits one task to the strand.
+     *
+     * @param task The task to be executed after the ones already submitted.
+     *
+     * @pre
+     * - The parameter task is not null.
+     */
+    void post(Task task);
+
+protected:
+
+    virtual void receive(MailboxMessage message);
+
+    /**
+     * @brief Cancels the task (see @ref ITask::cancel).
+     */
+    virtual void discard(MailboxMessage message);
+
+};
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief Set of strands identified by a key, for instance a session.
+ *
+ * Tasks posted with the same key run one at a time in FIFO order, tasks
+ * posted with different keys run in parallel (see @ref Strand). The strand
+ * of a key is created by the first task posted with it, and dropped once
+ * idle when the set grows, so keys can come and go without limits.
+ *
+ * The keys are spread over a fixed number of shards, each one with its own
+ * lock, to keep the concurrent posts with different keys from contending.
+ *
+ * @tparam Key Type of the keys.
+ * @tparam Hash Hash function for the keys.
+ *
+ * @note
+ * - Method @ref post is thread safe.
+ * - The same notes of @ref Actor about the pool and the lifetime apply.
+ *
+ * @ingroup threading-high
+ */
+template<typename Key, typename Hash = std::hash<Key> >
+class StrandMapT
+{
+
+public:
+
+    /**
+     * @brief Constructor.
+     *
+     * @param pool The thread pool executing the tasks.
+     */
+    explicit inline StrandMapT(IThreadPool &pool);
+
+    /**
+     * @brief Submits one task to the strand of a key.
+     *
+     * @param key The key identifying the strand.
+     *
+     * @param task The task to be executed after the ones already submitted
+     *        with the same key.
+     *
+     * @pre
+     * - The parameter task is not null.
+     */
+    inline void post(const Key &key, Task task);
+
+    /**
+     * @brief Returns the number of strands currently allocated.
+     */
+    inline std::size_t size() const;
+
+private:
+
+    typedef ::Locker<Mutex> Locker;
+
+    enum
+    {
+        SHARD_COUNT = 16,
+
+        // Idle strands are dropped when a shard doubles its size since the
+        // last sweep, starting from:
+        MIN_SWEEP_SIZE = 64
+    };
+
+    struct Shard
+    {
+        mutable Mutex m_mutex;
+        std::unordered_map<Key, std::unique_ptr<Strand>, Hash> m_strands;
+        std::size_t m_sweep_size;
+
+        Shard()
+                : m_mutex("StrandMap"),
+                  m_sweep_size(MIN_SWEEP_SIZE)
+        {
+        }
+    };
+
+    inline static void sweep(Shard &shard);
+
+    IThreadPool &m_pool;
+    Hash m_hash;
+    Shard m_shards[SHARD_COUNT];
+
+};
+
+// ----------------------------------------------------------------------------
+
+template<typename Key, typename Hash>
+StrandMapT<Key, Hash>::StrandMapT(IThreadPool &pool)
+        : m_pool(pool)
+{
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename Key, typename Hash>
+void
+StrandMapT<Key, Hash>::post(const Key &key, Task task)
+{
+    Shard &shard = m_shards[m_hash(key) % SHARD_COUNT];
+    Locker locker(shard.m_mutex);
+
+    auto found = shard.m_strands.find(key);
+    if (found == shard.m_strands.end())
+    {
+        if (shard.m_strands.size() >= shard.m_sweep_size)
+        {
+            sweep(shard);
+        }
+
+        std::unique_ptr<Strand> strand(new Strand(m_pool));
+        found = shard.m_strands.emplace(key, std::move(strand)).first;
+    }
+
+    // Posted while the shard is locked: an idle strand can't be dropped in
+    // the meanwhile.
+    found->second->post(task);
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename Key, typename Hash>
+std::size_t
+StrandMapT<Key, Hash>::size() const
+{
+    std::size_t ret = 0;
+    for (auto &shard: m_shards)
+    {
+        Locker locker(shard.m_mutex);
+        ret += shard.m_strands.size();
+    }
+
+    return ret;
+}
+
+// ----------------------------------------------------------------------------
+
+template<typename Key, typename Hash>
+void
+StrandMapT<Key, Hash>::sweep(Shard &shard)
+{
+    for (auto i = shard.m_strands.begin(); i != shard.m_strands.end();)
+    {
+        // Without pending tasks nobody but this shard can reach the strand,
+        // its last activation doesn't touch it after releasing the count:
+        if (0 == i->second->pending())
+        {
+            i = shard.m_strands.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    shard.m_sweep_size = shard.m_strands.size() * 2;
+    if (shard.m_sweep_size < MIN_SWEEP_SIZE)
+    {
+        shard.m_sweep_size = MIN_SWEEP_SIZE;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+#endif // STRAND_H
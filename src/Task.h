@@ -28,8 +28,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <assert.h>
+#include <cstdint>
+#include <exception>
 #include <memory>
 
+#include "CancellationToken.h"
 #include "Message.h"
 
 #ifndef TASK_H
@@ -52,6 +55,18 @@ class ITask
 
 public:
 
+    /**
+     * @brief Default constructor.
+     */
+    ITask()
+            : m_cancelled(false),
+              m_enqueued_ns(0),
+              m_deadline_ns(0),
+              m_detached(false),
+              m_internal(false)
+    {
+    }
+
     /**
      * @brief Destructor.
      */
@@ -66,11 +81,162 @@ public:
 
     /**
      * @brief Cancels the task.
+     *
+     * Called by the thread pool in place of @ref execute for a task that is
+     * not going to be executed: because its cancellation token have been
+     * cancelled (see @ref set_cancellation_token) or because the pool have
+     * been cancelled.
      */
     virtual void cancel()
     {
     }
 
+    /**
+     * @brief Attaches a cancellation token to the task.
+     *
+     * @param token The token cancelling the task.
+     *
+     * @pre
+     * - The task have not been submitted yet.
+     */
+    void set_cancellation_token(const CancellationToken &token)
+    {
+        m_cancellation_flag = token.m_flag;
+    }
+
+    /**
+     * @brief Returns @a true if the task have been cancelled, through its
+     * cancellation token or by the thread pool.
+     *
+     * The check is cheap enough to be polled by long running tasks from
+     * their method @ref execute in order to stop early.
+     */
+    bool is_cancelled() const
+    {
+        return m_cancelled
+               || (m_cancellation_flag
+                   && m_cancellation_flag->load(std::memory_order_acquire));
+    }
+
+    /**
+     * @brief Returns the deadline of the task (see @ref clock_now_ns), or
+     * @a zero if it have been pushed without one (see @ref
+     * IThreadPool::push(Task, std::uint64_t)).
+     */
+    std::uint64_t deadline_ns() const
+    {
+        return m_deadline_ns;
+    }
+
+    /**
+     * @brief Returns @a true if the method @ref execute exited with an
+     * exception.
+     *
+     * The exception is caught by the thread (see @ref IThread::create) or by
+     * the thread pool worker (see @ref IThreadPool::push) executing the
+     * task, that keeps running.
+     *
+     * @pre
+     * - The execution is over (the thread have been joined, or the task have
+     *   been popped from the thread pool).
+     */
+    bool has_failed() const
+    {
+        return bool(m_exception);
+    }
+
+    /**
+     * @brief Returns the exception thrown by the method @ref execute, if any
+     * (see @ref has_failed).
+     */
+    std::exception_ptr exception() const
+    {
+        return m_exception;
+    }
+
+    /**
+     * @brief Throws again the exception thrown by the method @ref execute, if
+     * any (see @ref has_failed).
+     */
+    void rethrow_if_failed() const
+    {
+        if (m_exception)
+        {
+            std::rethrow_exception(m_exception);
+        }
+    }
+
+private:
+
+    // Bookkeeping of the thread or thread pool executing the task:
+    friend class Actor;
+    friend class FairScheduler;
+    friend class Strand;
+    friend class ThreadPosix;
+    friend class ThreadPoolPosix;
+    friend class ThreadPoolWorker;
+
+    std::exception_ptr m_exception;
+
+    // Set for the tasks cancelled by the thread pool:
+    bool m_cancelled;
+    std::shared_ptr<const std::atomic<bool> > m_cancellation_flag;
+
+    std::uint64_t m_enqueued_ns;
+    std::uint64_t m_deadline_ns;
+
+    // Set for the tasks posted with IThreadPool::post:
+    bool m_detached;
+
+    // Set for the activations of the schedulers built on the pool (actors,
+    // strands...), that the rejection policies must neither drop nor run on
+    // the stack of the caller: their post fails and they retry.
+    bool m_internal;
+
+    // Executes the task, the exception it throws is attached to it since the
+    // executing thread keeps running. Returns false if it failed:
+    static bool run_execute(ITask &task)
+    {
+        try
+        {
+            task.execute();
+        }
+        catch (...)
+        {
+            task.m_exception = std::current_exception();
+            return false;
+        }
+
+        return true;
+    }
+
+    // Marks the task as cancelled and notifies it instead of executing it:
+    static void run_cancel(ITask &task)
+    {
+        task.m_cancelled = true;
+        try
+        {
+            task.cancel();
+        }
+        catch (...)
+        {
+            task.m_exception = std::current_exception();
+        }
+    }
+
+    // Executes the task, or notifies it if it have been cancelled:
+    static void run(ITask &task)
+    {
+        if (task.is_cancelled())
+        {
+            run_cancel(task);
+        }
+        else
+        {
+            run_execute(task);
+        }
+    }
+
 };
 
 // -----------------------------------------------------------------------------
@@ -0,0 +1,220 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "TaskTimeline.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <string>
+
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#endif
+
+// -----------------------------------------------------------------------------
+
+namespace
+{
+
+std::string
+demangle(const char *name)
+{
+    if (name == nullptr)
+    {
+        return "task";
+    }
+
+    std::string ret(name);
+
+#if defined(__GNUC__)
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (demangled != nullptr)
+    {
+        ret = demangled;
+        std::free(demangled);
+    }
+#endif
+
+    return ret;
+}
+
+// -----------------------------------------------------------------------------
+
+std::string
+escape(const std::string &text)
+{
+    std::string ret;
+    ret.reserve(text.size());
+    for (char c: text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            ret += '\\';
+        }
+        ret += c;
+    }
+
+    return ret;
+}
+
+// -----------------------------------------------------------------------------
+
+// Microseconds (the unit of the trace-event format) since the origin:
+void
+write_timestamp(std::ostream &stream,
+                std::uint64_t time_ns,
+                std::uint64_t origin_ns)
+{
+    std::uint64_t elapsed = time_ns - origin_ns;
+    stream << elapsed / 1000 << '.';
+
+    char fraction[4] = {
+        char('0' + elapsed / 100 % 10),
+        char('0' + elapsed / 10 % 10),
+        char('0' + elapsed % 10),
+        0 };
+    stream << fraction;
+}
+
+} // anonymous namespace
+
+// -----------------------------------------------------------------------------
+
+TaskTimeline::TaskTimeline(std::size_t capacity)
+        : m_entries(capacity),
+          m_next(0)
+{
+}
+
+// -----------------------------------------------------------------------------
+
+std::size_t
+TaskTimeline::size() const
+{
+    return std::min(m_next.load(std::memory_order_relaxed), m_entries.size());
+}
+
+// -----------------------------------------------------------------------------
+
+std::size_t
+TaskTimeline::dropped() const
+{
+    return m_next.load(std::memory_order_relaxed) - size();
+}
+
+// -----------------------------------------------------------------------------
+
+void
+TaskTimeline::clear()
+{
+    m_next.store(0, std::memory_order_relaxed);
+}
+
+// -----------------------------------------------------------------------------
+
+void
+TaskTimeline::write_chrome_trace(std::ostream &stream) const
+{
+    const std::size_t count = size();
+
+    std::uint64_t origin_ns = 0;
+    std::set<std::uint32_t> workers;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (i == 0 || m_entries[i].enqueue_ns < origin_ns)
+        {
+            origin_ns = m_entries[i].enqueue_ns;
+        }
+        workers.insert(m_entries[i].worker);
+    }
+
+    stream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+
+    const char *separator = "";
+    for (auto worker: workers)
+    {
+        stream << separator
+               << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+               << worker
+               << ",\"args\":{\"name\":\"worker " << worker << "\"}}";
+        separator = ",\n";
+    }
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const Entry &entry = m_entries[i];
+        std::string name = escape(demangle(entry.name));
+
+        // Time spent in the queue, as an asynchronous slice:
+        stream << separator
+               << "{\"name\":\"queued\",\"cat\":\"queue\",\"ph\":\"b\","
+               << "\"pid\":1,\"tid\":" << entry.worker
+               << ",\"id\":" << i << ",\"ts\":";
+        write_timestamp(stream, entry.enqueue_ns, origin_ns);
+        stream << "},\n"
+               << "{\"name\":\"queued\",\"cat\":\"queue\",\"ph\":\"e\","
+               << "\"pid\":1,\"tid\":" << entry.worker
+               << ",\"id\":" << i << ",\"ts\":";
+        write_timestamp(stream, entry.start_ns, origin_ns);
+        stream << "}";
+        separator = ",\n";
+
+        // Execution, as a slice of the worker:
+        stream << separator
+               << "{\"name\":\"" << name << "\",\"cat\":\"task\",\"ph\":\"X\","
+               << "\"pid\":1,\"tid\":" << entry.worker << ",\"ts\":";
+        write_timestamp(stream, entry.start_ns, origin_ns);
+        stream << ",\"dur\":";
+        write_timestamp(stream, entry.finish_ns, entry.start_ns);
+        stream << "}";
+    }
+
+    stream << "\n]}\n";
+}
+
+// -----------------------------------------------------------------------------
+
+bool
+TaskTimeline::write_chrome_trace(const char *path) const
+{
+    std::ofstream stream(path);
+    if (!stream)
+    {
+        return false;
+    }
+
+    write_chrome_trace(stream);
+
+    return bool(stream);
+}
+
+// -----------------------------------------------------------------------------
@@ -0,0 +1,158 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TASKTIMELINE_H
+#define TASKTIMELINE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Recorder of the tasks executed by a thread pool, to be visualized
+ * as a timeline.
+ *
+ * The thread pool records one entry for each executed task (see @ref
+ * ThreadPoolOptions::timeline). The recorded entries can be exported in the
+ * Chrome trace-event JSON format, which can be loaded by Perfetto
+ * (https://ui.perfetto.dev) or chrome://tracing to show what each worker
+ * did over time.
+ *
+ * Recording is lock-free: entries are appended into storage allocated once
+ * at construction, entries exceeding the capacity are dropped.
+ *
+ * @ingroup threading-high
+ */
+class TaskTimeline
+{
+
+public:
+
+    /**
+     * @brief Execution of one task.
+     */
+    struct Entry
+    {
+        const char *name;        ///< Name of the task (its dynamic type).
+        std::uint32_t worker;    ///< Index of the worker executing the task.
+        std::uint64_t enqueue_ns; ///< When the task has been pushed.
+        std::uint64_t start_ns;  ///< When the execution has started.
+        std::uint64_t finish_ns; ///< When the execution has finished.
+    };
+
+    /**
+     * @brief Constructor.
+     *
+     * @param capacity Maximum number of entries that can be recorded.
+     */
+    explicit TaskTimeline(std::size_t capacity = 1u << 20);
+
+    /**
+     * @brief Records the execution of one task.
+     *
+     * Can be called concurrently by many threads.
+     */
+    void
+    record(const Entry &entry)
+    {
+        std::size_t index = m_next.fetch_add(1, std::memory_order_relaxed);
+        if (index < m_entries.size())
+        {
+            m_entries[index] = entry;
+        }
+    }
+
+    /**
+     * @brief Returns the number of recorded entries.
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief Returns the number of entries dropped because the recorder was
+     * full.
+     */
+    std::size_t dropped() const;
+
+    /**
+     * @brief Discards all the recorded entries.
+     *
+     * @pre
+     * - No entry is being recorded.
+     */
+    void clear();
+
+    /**
+     * @brief Returns the entry at the passed index.
+     *
+     * @pre
+     * - No entry is being recorded.
+     */
+    const Entry &
+    entry(std::size_t index) const
+    {
+        return m_entries[index];
+    }
+
+    /**
+     * @brief Writes the recorded entries in the Chrome trace-event JSON
+     * format.
+     *
+     * Each worker is one thread of the trace, each task is shown as a slice
+     * of its worker and the time spent in the queue before the execution as
+     * an asynchronous slice.
+     *
+     * @pre
+     * - No entry is being recorded (e.g. the pool have been joined).
+     */
+    void write_chrome_trace(std::ostream &stream) const;
+
+    /**
+     * @brief Writes the recorded entries in the Chrome trace-event JSON
+     * format into a file.
+     *
+     * @return @a false if the file cannot be written.
+     *
+     * @copydetails write_chrome_trace(std::ostream &) const
+     */
+    bool write_chrome_trace(const char *path) const;
+
+private:
+
+    std::vector<Entry> m_entries;
+    std::atomic<std::size_t> m_next;
+
+};
+
+// -----------------------------------------------------------------------------
+
+#endif // TASKTIMELINE_H
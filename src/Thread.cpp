@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "Thread.h"
 
 #include "Cond.h"
+#include "Probes.h"
 #include "Trace.h"
 
 #include <pthread.h>
@@ -110,11 +111,13 @@ class ThreadPosix
 
     pthread_t m_thread;
     volatile bool m_running;
+    bool m_joined;
 
 public:
 
     ThreadPosix(bool fetch_self)
-            : m_running(false)
+            : m_running(false),
+              m_joined(false)
     {
         if (fetch_self)
         {
@@ -137,6 +140,7 @@ public:
             Locker<Mutex> lock(init_data.m_mutex);
 
             ::pthread_create(&m_thread, &attr, run_thread, &init_data);
+            TP_PROBE1(thread__create, m_thread);
 
             init_data.m_cond.wait(init_data.m_mutex);
         }
@@ -163,7 +167,13 @@ public:
     join()
     {
         assert(m_thread != ::pthread_self());
-        ::pthread_join(m_thread, nullptr);
+        if (!m_joined)
+        {
+            TP_PROBE1(thread__join__start, m_thread);
+            ::pthread_join(m_thread, nullptr);
+            TP_PROBE1(thread__join__done, m_thread);
+            m_joined = true;
+        }
     }
 
     virtual void yield() const
@@ -178,6 +188,26 @@ public:
         return reinterpret_cast< void *>( m_thread );
     }
 
+    virtual bool
+    set_affinity(std::size_t cpu)
+    {
+#ifdef __linux__
+        if (cpu >= CPU_SETSIZE)
+        {
+            return false;
+        }
+
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+
+        return 0 == ::pthread_setaffinity_np(m_thread, sizeof(cpus), &cpus);
+#else
+        (void) cpu;
+        return false;
+#endif
+    }
+
 private:
 
     static void *
@@ -202,7 +232,17 @@ private:
                 init_data.m_cond.signal();
             }
 
-            task->execute();
+            // An exception escaping the thread would terminate the process:
+            try
+            {
+                task->execute();
+            }
+            catch (...)
+            {
+                task->m_exception = std::current_exception();
+                TRACE_ERROR(TRACE_CATEGORY_THREAD,
+                            "Task terminated by an exception");
+            }
 
             (*running_flag) = false;
         }
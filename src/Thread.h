@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "Task.h"
 
 #include <assert.h>
+#include <cstddef>
 #include <memory>
 
 #ifndef THREAD_H
@@ -135,6 +136,19 @@ public:
      */
     virtual void *handle() = 0;
 
+    /**
+     * @brief If supported by the platform implementation, binds the thread
+     * to one processor.
+     *
+     * @param cpu Index of the processor, as numbered by the operating
+     *        system.
+     *
+     * @return @a true on success, @a false if the processor doesn't exist,
+     *         is not allowed to the process, or the platform doesn't support
+     *         it.
+     */
+    virtual bool set_affinity(std::size_t cpu) = 0;
+
 };
 
 // -----------------------------------------------------------------------------
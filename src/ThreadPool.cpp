@@ -29,29 +29,672 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "ThreadPool.h"
 
+#include "Clock.h"
+#include "EventCount.h"
+#include "EventFd.h"
 #include "MessageQueue.h"
+#include "Mutex.h"
+#include "Probes.h"
 #include "Thread.h"
+#include "Trace.h"
 
+#include <typeinfo>
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <iostream>
 #include <string>
 #include <vector>
 
 // -----------------------------------------------------------------------------
 
+/**
+ * Counters updated by one single worker.
+ */
+struct ThreadPoolWorkerCounters
+{
+    std::atomic<std::uint64_t> m_executed;
+    std::atomic<std::uint64_t> m_failed;
+    std::atomic<std::uint64_t> m_cancelled;
+    std::atomic<std::uint64_t> m_expired;
+    std::atomic<std::uint64_t> m_missed;
+    std::atomic<std::uint64_t> m_local;
+    std::atomic<std::uint64_t> m_busy_ns;
+    std::atomic<std::uint64_t> m_idle_ns;
+
+    // Beginning of the current idle period, zero while executing a task. The
+    // worker is idle from its creation, even before its thread runs:
+    std::atomic<std::uint64_t> m_idle_since_ns;
+
+    Histogram m_queue_wait;
+    Histogram m_execution;
+
+    ThreadPoolWorkerCounters()
+            : m_executed(0),
+              m_failed(0),
+              m_cancelled(0),
+              m_expired(0),
+              m_missed(0),
+              m_local(0),
+              m_busy_ns(0),
+              m_idle_ns(0),
+              m_idle_since_ns(clock_now_ns())
+    {
+    }
+
+    void
+    snapshot(ThreadPoolWorkerStats &dst, std::uint64_t now_ns) const
+    {
+        dst.executed = m_executed.load(std::memory_order_relaxed);
+        dst.failed = m_failed.load(std::memory_order_relaxed);
+        dst.cancelled = m_cancelled.load(std::memory_order_relaxed);
+        dst.expired = m_expired.load(std::memory_order_relaxed);
+        dst.missed = m_missed.load(std::memory_order_relaxed);
+        dst.local = m_local.load(std::memory_order_relaxed);
+        dst.busy_ns = m_busy_ns.load(std::memory_order_relaxed);
+        dst.idle_ns = m_idle_ns.load(std::memory_order_relaxed);
+
+        std::uint64_t idle_since = m_idle_since_ns.load(
+                std::memory_order_relaxed);
+        if (idle_since != 0 && now_ns > idle_since)
+        {
+            dst.idle_ns += now_ns - idle_since;
+        }
+    }
+
+    // Only the owner worker writes, no need for read-modify-write operations:
+    static void
+    add(std::atomic<std::uint64_t> &counter, std::uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value,
+                      std::memory_order_relaxed);
+    }
+};
+
+// -----------------------------------------------------------------------------
+
+/**
+ * Executed tasks, buffered by each worker into its own list and merged into
+ * one list on demand when popped. The lock of a worker list is contended
+ * only while the caller merges it.
+ */
+class ThreadPoolCompletions
+{
+
+    typedef ::Locker<Mutex> Locker;
+
+    // A task stamped with its rank of completion:
+    struct Entry
+    {
+        std::uint64_t m_sequence;
+        Task m_task;
+    };
+
+    struct Buffer
+    {
+        Mutex m_mutex;
+        std::deque<Entry> m_tasks;
+
+        // Modified only while the mutex is held, to skip the empty buffers
+        // without locking them:
+        std::atomic<std::size_t> m_size;
+
+        // Keeps the buffers of different workers on different cache lines:
+        char m_padding[64];
+
+        Buffer()
+                : m_mutex("ThreadPoolCompletions"),
+                  m_size(0)
+        {
+        }
+    };
+
+    // One buffer for each worker, and a last one for the tasks that have
+    // not been executed:
+    std::vector<std::unique_ptr<Buffer> > m_buffers;
+
+    // Next rank of completion, taken with the lock of a buffer held:
+    std::atomic<std::uint64_t> m_sequence;
+
+    // Tasks merged from the buffers in their order of completion and not
+    // popped yet, the runs of the buffers being sorted in m_runs:
+    Mutex m_mutex;
+    std::deque<Task> m_merged;
+    std::vector<Entry> m_runs;
+
+    // Tasks executed and not popped yet, wherever they are:
+    std::atomic<std::size_t> m_count;
+
+    // Set when no task is going to be executed any more:
+    std::atomic<bool> m_finished;
+
+    EventCount m_event_count;
+    std::atomic<EventFd *> m_readiness;
+    WaitStrategy m_wait_strategy;
+
+public:
+
+    ThreadPoolCompletions(std::size_t num_buffers,
+                          const WaitStrategy &wait_strategy)
+            : m_sequence(0),
+              m_mutex("ThreadPoolCompletions"),
+              m_count(0),
+              m_finished(false),
+              m_readiness(nullptr),
+              m_wait_strategy(wait_strategy)
+    {
+        m_buffers.reserve(num_buffers + 1);
+        for (std::size_t i = 0; i < num_buffers + 1; ++i)
+        {
+            m_buffers.emplace_back(new Buffer());
+        }
+    }
+
+    ~ThreadPoolCompletions()
+    {
+        delete m_readiness.load();
+    }
+
+    // Called by the worker owning the buffer:
+    void
+    push(std::size_t buffer_index, Task task)
+    {
+        Buffer &buffer = *m_buffers[buffer_index];
+        bool was_empty;
+        {
+            Locker locker(buffer.m_mutex);
+            Entry entry = { m_sequence.fetch_add(1), task };
+            buffer.m_tasks.push_back(entry);
+            buffer.m_size.store(buffer.m_tasks.size(),
+                                std::memory_order_release);
+
+            // Counted before merge() can see it, so that the count never
+            // falls behind the tasks that can be popped:
+            was_empty = count_added();
+        }
+
+        if (was_empty)
+        {
+            notify();
+        }
+    }
+
+    // Called by the pool for the tasks that have not been executed:
+    void
+    push_merged(Task task)
+    {
+        push(m_buffers.size() - 1, task);
+    }
+
+    std::size_t
+    pop(Task &task, bool blocking)
+    {
+        for (;;)
+        {
+            if (m_count.load(std::memory_order_acquire) > 0)
+            {
+                Locker locker(m_mutex);
+                if (m_merged.empty())
+                {
+                    merge();
+                }
+
+                if (!m_merged.empty())
+                {
+                    // The popped task and the ones completed not popped yet,
+                    // merged or not:
+                    task = m_merged.front();
+                    m_merged.pop_front();
+                    return m_count.fetch_sub(1);
+                }
+            }
+
+            if (!blocking || !wait())
+            {
+                return 0;
+            }
+        }
+    }
+
+    std::size_t
+    pop_all(std::deque<Task> &tasks, std::size_t max_count, bool blocking)
+    {
+        if (0 == max_count)
+        {
+            return 0;
+        }
+
+        for (;;)
+        {
+            if (m_count.load(std::memory_order_acquire) > 0)
+            {
+                Locker locker(m_mutex);
+                merge();
+
+                std::size_t ret = std::min(m_merged.size(), max_count);
+                if (ret == m_merged.size() && tasks.empty())
+                {
+                    tasks.swap(m_merged);
+                }
+                else
+                {
+                    for (std::size_t i = 0; i < ret; ++i)
+                    {
+                        tasks.push_back(std::move(m_merged.front()));
+                        m_merged.pop_front();
+                    }
+                }
+
+                if (ret > 0)
+                {
+                    m_count.fetch_sub(ret);
+                    return ret;
+                }
+            }
+
+            if (!blocking || !wait())
+            {
+                return 0;
+            }
+        }
+    }
+
+    // Releases the blocked callers once the queued tasks are popped:
+    void
+    finish()
+    {
+        m_finished.store(true);
+        m_event_count.notify();
+    }
+
+    int
+    readiness_fd()
+    {
+        EventFd *readiness = m_readiness.load();
+        if (nullptr == readiness)
+        {
+            EventFd *created = new EventFd();
+            if (m_readiness.compare_exchange_strong(readiness, created))
+            {
+                readiness = created;
+
+                // Already ready, no transition is going to signal it:
+                if (m_count.load() > 0 || m_finished.load())
+                {
+                    readiness->signal();
+                }
+            }
+            else
+            {
+                delete created;
+            }
+        }
+
+        return readiness->fd();
+    }
+
+    void
+    clear_readiness()
+    {
+        assert(nullptr != m_readiness.load());
+
+        m_readiness.load()->clear();
+    }
+
+private:
+
+    // Counts one more task, returns true if there were none (only the
+    // transitions from empty may have a waiter to notify):
+    bool
+    count_added()
+    {
+        return 0 == m_count.fetch_add(1);
+    }
+
+    void
+    notify()
+    {
+        m_event_count.notify();
+
+        EventFd *readiness = m_readiness.load();
+        if (nullptr != readiness)
+        {
+            readiness->signal();
+        }
+    }
+
+    // Appends the tasks of the buffers to the merged list in their order
+    // of completion, the mutex must be locked. Only the tasks ranked before
+    // the merge are taken: all of them are in their buffer then, the ones
+    // left behind complete after the tasks merged.
+    void
+    merge()
+    {
+        const std::uint64_t sequence = m_sequence.load();
+
+        m_runs.clear();
+        for (auto &buffer: m_buffers)
+        {
+            if (0 == buffer->m_size.load(std::memory_order_acquire))
+            {
+                continue;
+            }
+
+            std::size_t middle = m_runs.size();
+            {
+                Locker locker(buffer->m_mutex);
+                std::deque<Entry> &tasks = buffer->m_tasks;
+                while (!tasks.empty()
+                        && tasks.front().m_sequence < sequence)
+                {
+                    m_runs.push_back(std::move(tasks.front()));
+                    tasks.pop_front();
+                }
+                buffer->m_size.store(tasks.size(), std::memory_order_relaxed);
+            }
+
+            // Each buffer is sorted already:
+            std::inplace_merge(m_runs.begin(),
+                               m_runs.begin() + middle,
+                               m_runs.end(),
+                               [](const Entry &a, const Entry &b)
+                               {
+                                   return a.m_sequence < b.m_sequence;
+                               });
+        }
+
+        for (auto &entry: m_runs)
+        {
+            m_merged.push_back(std::move(entry.m_task));
+        }
+        m_runs.clear();
+    }
+
+    // Waits for an executed task, returns false if none can come any more:
+    bool
+    wait()
+    {
+        if (m_finished.load())
+        {
+            return false;
+        }
+
+        if (m_wait_strategy.poll([this]()
+            {
+                return m_count.load() > 0 || m_finished.load();
+            }))
+        {
+            return true;
+        }
+
+        EventCount::Key key = m_event_count.prepare_wait();
+        if (m_count.load() > 0 || m_finished.load())
+        {
+            m_event_count.cancel_wait();
+        }
+        else
+        {
+            m_event_count.wait(key);
+        }
+
+        return true;
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+/**
+ * Spare threads standing in for the tasks blocked inside a BlockingRegion.
+ * A spare thread runs a worker of its own, which retires between two tasks
+ * once the spare threads outnumber the open regions; an idle spare waiting
+ * for a task retires after the next one, or when the pool shuts down.
+ */
+class ThreadPoolSpares
+{
+
+    typedef ::Locker<Mutex> Locker;
+
+    IMessageQueue &m_input_queue;
+    ThreadPoolCompletions &m_completions;
+    TaskTimeline *m_timeline;
+    ThreadPoolOptions m_options;
+
+    // One slot for each spare thread allowed, the spare of slot i is the
+    // worker of index num_threads + i:
+    std::vector<Thread> m_threads;
+    std::vector<bool> m_running;
+    std::vector<std::unique_ptr<ThreadPoolWorkerCounters> > m_counters;
+
+    // A slot is starting from its reservation until its thread is stored,
+    // its spare doesn't retire meanwhile so that the slot isn't reused:
+    std::vector<bool> m_starting;
+
+    Mutex m_mutex;
+    std::size_t m_regions;
+    std::size_t m_num_running;
+    bool m_closed;
+
+    std::atomic<std::uint64_t> m_spawned;
+
+public:
+
+    ThreadPoolSpares(IMessageQueue &input_queue,
+                     ThreadPoolCompletions &completions,
+                     TaskTimeline *timeline,
+                     const ThreadPoolOptions &options)
+            : m_input_queue(input_queue),
+              m_completions(completions),
+              m_timeline(timeline),
+              m_options(options),
+              m_threads(options.max_spare_threads),
+              m_running(options.max_spare_threads, false),
+              m_starting(options.max_spare_threads, false),
+              m_mutex("ThreadPoolSpares"),
+              m_regions(0),
+              m_num_running(0),
+              m_closed(false),
+              m_spawned(0)
+    {
+        m_counters.reserve(options.max_spare_threads);
+        for (std::size_t i = 0; i < options.max_spare_threads; ++i)
+        {
+            // Not idle until a spare thread starts:
+            m_counters.emplace_back(new ThreadPoolWorkerCounters());
+            m_counters.back()->m_idle_since_ns.store(0);
+        }
+    }
+
+    // A task enters a region, starts a spare thread if there are less of
+    // them than regions. The slot is reserved under the lock, the previous
+    // spare of the slot is joined and the new one started outside of it:
+    void
+    enter()
+    {
+        std::size_t slot = 0;
+        Thread retired;
+        {
+            Locker locker(m_mutex);
+            ++m_regions;
+
+            if (m_closed || m_num_running >= m_regions)
+            {
+                return;
+            }
+
+            while (slot < m_running.size() && m_running[slot])
+            {
+                ++slot;
+            }
+            if (slot == m_running.size())
+            {
+                return;
+            }
+
+            m_running[slot] = true;
+            m_starting[slot] = true;
+            ++m_num_running;
+            retired.swap(m_threads[slot]);
+        }
+
+        // The previous spare of the slot has retired, its thread is
+        // terminating:
+        if (retired)
+        {
+            retired->join();
+        }
+
+        Thread thread = spawn(slot);
+        {
+            Locker locker(m_mutex);
+            m_starting[slot] = false;
+            if (!m_closed)
+            {
+                m_threads[slot] = thread;
+                return;
+            }
+        }
+
+        // join() has taken the spares meanwhile. The caller runs on a worker
+        // or a spare the pool is joining, which keeps the pool alive until
+        // this thread terminates:
+        thread->join();
+    }
+
+    void
+    leave()
+    {
+        Locker locker(m_mutex);
+        assert(m_regions > 0);
+        --m_regions;
+    }
+
+    // Called by a spare between two tasks, returns true if it must retire:
+    bool
+    retire(std::uint32_t index)
+    {
+        std::size_t slot = index - m_options.num_threads;
+
+        Locker locker(m_mutex);
+        if (m_num_running <= m_regions || m_starting[slot])
+        {
+            return false;
+        }
+
+        m_running[slot] = false;
+        --m_num_running;
+        return true;
+    }
+
+    // Waits for the termination of the spare threads, once the input queue
+    // has been closed or cancelled:
+    void
+    join()
+    {
+        std::vector<Thread> threads;
+        {
+            Locker locker(m_mutex);
+            m_closed = true;
+            threads.swap(m_threads);
+        }
+
+        for (auto &thread: threads)
+        {
+            if (thread)
+            {
+                thread->join();
+            }
+        }
+    }
+
+    const std::vector<std::unique_ptr<ThreadPoolWorkerCounters> > &
+    counters() const
+    {
+        return m_counters;
+    }
+
+    std::uint64_t
+    spawned() const
+    {
+        return m_spawned.load(std::memory_order_relaxed);
+    }
+
+private:
+
+    // Starts the spare of a reserved slot, defined after the worker:
+    Thread spawn(std::size_t slot);
+
+};
+
+// -----------------------------------------------------------------------------
+
 class ThreadPoolWorker
         :
                 public ITask
 {
 
+    enum
+    {
+        // Consecutive tasks fetched from the local slot before looking at
+        // the shared queue, to not starve it:
+        LOCAL_RUN_LIMIT = 3,
+
+        // Stack touched by a worker locking the memory, and the size of a
+        // page:
+        PREFAULT_STACK_SIZE = 256 * 1024,
+        PREFAULT_PAGE_SIZE = 4096
+    };
+
+    // The worker running on the current thread, if any:
+    static thread_local ThreadPoolWorker *s_current;
+
     IMessageQueue &m_input_queue;
-    IMessageQueue &m_output_queue;
+    ThreadPoolCompletions &m_completions;
+    std::uint32_t m_index;
+    TaskTimeline *m_timeline;
+    ThreadPoolWorkerCounters &m_counters;
+    bool m_drop_expired;
+    bool m_prefault_stack;
+
+    // Spare threads of the pool, if enabled, and whether this worker is one
+    // of them:
+    ThreadPoolSpares *m_spares;
+    bool m_spare;
+
+    // Processor to run on, if bound:
+    bool m_bound;
+    std::size_t m_cpu;
+
+    // Task submitted by the running one, accessed only by the thread of the
+    // worker:
+    Task m_local;
+    std::size_t m_local_runs;
 
 public:
 
     ThreadPoolWorker(IMessageQueue &input_queue,
-                     IMessageQueue &output_queue)
+                     ThreadPoolCompletions &completions,
+                     std::uint32_t index,
+                     TaskTimeline *timeline,
+                     ThreadPoolWorkerCounters &counters,
+                     const ThreadPoolOptions &options,
+                     ThreadPoolSpares *spares,
+                     bool spare)
             : m_input_queue(input_queue),
-              m_output_queue(output_queue)
+              m_completions(completions),
+              m_index(index),
+              m_timeline(timeline),
+              m_counters(counters),
+              m_drop_expired(options.drop_expired),
+              m_prefault_stack(options.lock_memory),
+              m_spares(spares),
+              m_spare(spare),
+              m_bound(!options.cpus.empty()),
+              m_cpu(m_bound ? options.cpus[index % options.cpus.size()] : 0),
+              m_local_runs(0)
     {
     }
 
@@ -63,19 +706,274 @@ public:
     virtual void
     execute()
     {
+        // Before touching any memory, so that it's local to the processor:
+        if (m_bound && !IThread::self()->set_affinity(m_cpu))
+        {
+            TRACE_WARNING(TRACE_CATEGORY_POOL,
+                          "Worker " << m_index << " not bound to processor "
+                          << m_cpu);
+        }
+
+        if (m_prefault_stack)
+        {
+            prefault_stack();
+        }
+
+        // Zero for a spare thread reusing the counters of a retired one:
+        std::uint64_t idle_since = m_counters.m_idle_since_ns.load(
+                std::memory_order_relaxed);
+        if (0 == idle_since)
+        {
+            idle_since = clock_now_ns();
+            m_counters.m_idle_since_ns.store(idle_since,
+                                             std::memory_order_relaxed);
+        }
+        s_current = this;
+
         // For each fetched message:
         Task task;
-        while (m_input_queue.popT(task, true))
+        bool retired = false;
+        while (!(retired = retiring()) && fetch(task))
         {
-            task->execute();
-            m_output_queue.push(task);
+            // Cancelled while queued or too late, costs no execution:
+            bool cancelled = task->is_cancelled();
+            if (cancelled || is_expired(*task))
+            {
+                ThreadPoolWorkerCounters::add(cancelled
+                                              ? m_counters.m_cancelled
+                                              : m_counters.m_expired, 1);
+                cancel_task(*task);
+                if (!task->m_detached)
+                {
+                    m_completions.push(m_index, task);
+                }
+                continue;
+            }
+
+            std::uint64_t start = clock_now_ns();
+            m_counters.m_idle_since_ns.store(0, std::memory_order_relaxed);
+            ThreadPoolWorkerCounters::add(m_counters.m_idle_ns,
+                                          start - idle_since);
+
+            TP_PROBE2(task__start, task.get(), m_index);
+
+            if (!execute_task(*task))
+            {
+                ThreadPoolWorkerCounters::add(m_counters.m_failed, 1);
+            }
+
+            TP_PROBE2(task__finish, task.get(), m_index);
+
+            idle_since = clock_now_ns();
+            account(*task, start, idle_since);
+
+            if (0 != task->m_deadline_ns && idle_since > task->m_deadline_ns)
+            {
+                ThreadPoolWorkerCounters::add(m_counters.m_missed, 1);
+            }
+
+            if (!task->m_detached)
+            {
+                m_completions.push(m_index, task);
+            }
         }
 
-        assert(m_input_queue.is_cancelled());
+        ThreadPoolWorkerCounters::add(m_counters.m_idle_ns,
+                                      clock_now_ns() - idle_since);
+        m_counters.m_idle_since_ns.store(0, std::memory_order_relaxed);
+        s_current = nullptr;
+
+        // Left into the slot when the pool has been cancelled:
+        if (m_local)
+        {
+            ThreadPoolWorkerCounters::add(m_counters.m_cancelled, 1);
+            cancel_task(*m_local);
+            if (!m_local->m_detached)
+            {
+                m_completions.push(m_index, m_local);
+            }
+            m_local.reset();
+        }
+
+        assert(retired
+               || m_input_queue.is_cancelled()
+               || m_input_queue.is_closed());
+    }
+
+    // Returns the worker running on the calling thread if it serves the
+    // given queue, null otherwise:
+    static ThreadPoolWorker *
+    current(const IMessageQueue &input_queue)
+    {
+        ThreadPoolWorker *worker = s_current;
+        if (nullptr != worker && &worker->m_input_queue == &input_queue)
+        {
+            return worker;
+        }
+
+        return nullptr;
+    }
+
+    // Returns the spare threads of the pool running the calling thread, null
+    // if none:
+    static ThreadPoolSpares *
+    current_spares()
+    {
+        ThreadPoolWorker *worker = s_current;
+        return nullptr != worker ? worker->m_spares : nullptr;
+    }
+
+    // Replaces the task of the local slot, returns the previous one. Called
+    // by the thread of the worker only:
+    Task
+    exchange_local(Task task)
+    {
+        m_local.swap(task);
+        return task;
+    }
+
+    // Executes the task, returns false if it failed. A failing task must not
+    // terminate the thread executing it:
+    static bool
+    execute_task(ITask &task)
+    {
+        if (!ITask::run_execute(task))
+        {
+            TRACE_WARNING(TRACE_CATEGORY_POOL,
+                          "Task terminated by an exception");
+            return false;
+        }
+
+        return true;
+    }
+
+    // Marks the task as cancelled and notifies it instead of executing it:
+    static void
+    cancel_task(ITask &task)
+    {
+        ITask::run_cancel(task);
+    }
+
+private:
+
+    // Touches the stack pages the tasks are going to use, to fault them in
+    // (and lock them, once the memory is locked) before serving any task:
+    static void
+    prefault_stack()
+    {
+        volatile char stack[PREFAULT_STACK_SIZE];
+        for (std::size_t i = 0; i < sizeof(stack); i += PREFAULT_PAGE_SIZE)
+        {
+            stack[i] = 0;
+        }
+    }
+
+    // A spare no longer needed retires, once its local slot is empty:
+    bool
+    retiring()
+    {
+        return m_spare && !m_local && m_spares->retire(m_index);
+    }
+
+    // Fetches the next task, the one of the local slot first:
+    bool
+    fetch(Task &task)
+    {
+        if (m_local && !m_input_queue.is_cancelled())
+        {
+            // Lets the shared queue in once in a while:
+            if (m_local_runs >= LOCAL_RUN_LIMIT
+                    && m_input_queue.popT(task, false) > 0)
+            {
+                m_local_runs = 0;
+                return true;
+            }
+
+            task.swap(m_local);
+            m_local.reset();
+            ++m_local_runs;
+            ThreadPoolWorkerCounters::add(m_counters.m_local, 1);
+            return true;
+        }
+
+        m_local_runs = 0;
+        return m_input_queue.popT(task, true) > 0;
+    }
+
+    bool
+    is_expired(const ITask &task) const
+    {
+        return m_drop_expired
+                && 0 != task.m_deadline_ns
+                && clock_now_ns() > task.m_deadline_ns;
+    }
+
+    void
+    account(ITask &task, std::uint64_t start, std::uint64_t finish)
+    {
+        ThreadPoolWorkerCounters::add(m_counters.m_executed, 1);
+        ThreadPoolWorkerCounters::add(m_counters.m_busy_ns, finish - start);
+        m_counters.m_idle_since_ns.store(finish, std::memory_order_relaxed);
+
+        m_counters.m_queue_wait.record(start - task.m_enqueued_ns);
+        m_counters.m_execution.record(finish - start);
+
+        if (m_timeline != nullptr)
+        {
+            TaskTimeline::Entry entry;
+            entry.name = typeid(task).name();
+            entry.worker = m_index;
+            entry.enqueue_ns = task.m_enqueued_ns;
+            entry.start_ns = start;
+            entry.finish_ns = finish;
+            m_timeline->record(entry);
+        }
     }
 
 };
 
+thread_local ThreadPoolWorker *ThreadPoolWorker::s_current = nullptr;
+
+// -----------------------------------------------------------------------------
+
+Thread
+ThreadPoolSpares::spawn(std::size_t slot)
+{
+    std::size_t index = m_options.num_threads + slot;
+    Task worker(new ThreadPoolWorker(m_input_queue,
+                                     m_completions,
+                                     std::uint32_t(index),
+                                     m_timeline,
+                                     *m_counters[slot],
+                                     m_options,
+                                     this,
+                                     true));
+
+    m_spawned.fetch_add(1, std::memory_order_relaxed);
+    return IThread::create(worker);
+}
+
+// -----------------------------------------------------------------------------
+
+BlockingRegion::BlockingRegion()
+        : m_spares(ThreadPoolWorker::current_spares())
+{
+    if (nullptr != m_spares)
+    {
+        m_spares->enter();
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+BlockingRegion::~BlockingRegion()
+{
+    if (nullptr != m_spares)
+    {
+        m_spares->leave();
+    }
+}
+
 // -----------------------------------------------------------------------------
 
 class ThreadPoolPosix
@@ -85,26 +983,70 @@ class ThreadPoolPosix
 
     std::vector<Thread> m_threads;
     std::unique_ptr<IMessageQueue> m_input_queue;
-    std::unique_ptr<IMessageQueue> m_output_queue;
+    std::unique_ptr<ThreadPoolCompletions> m_completions;
+    std::unique_ptr<ThreadPoolSpares> m_spares;
+    std::shared_ptr<TaskTimeline> m_timeline;
+    std::vector<std::unique_ptr<ThreadPoolWorkerCounters> > m_counters;
+    ThreadPoolOptions::RejectionPolicy m_rejection_policy;
+    bool m_local_slot;
     volatile bool m_cancelled;
 
+    // Outcomes of the pushes, updated by any producer:
+    std::atomic<std::uint64_t> m_rejected;
+    std::atomic<std::uint64_t> m_blocked;
+    std::atomic<std::uint64_t> m_caller_runs;
+    std::atomic<std::uint64_t> m_dropped;
+
 public:
 
-    ThreadPoolPosix(std::size_t num_threads,
-                    std::size_t task_capacity)
+    ThreadPoolPosix(const ThreadPoolOptions &options)
             :
-            m_cancelled(false)
+            m_timeline(options.timeline),
+            m_rejection_policy(options.rejection_policy),
+            m_local_slot(options.local_slot),
+            m_cancelled(false),
+            m_rejected(0),
+            m_blocked(0),
+            m_caller_runs(0),
+            m_dropped(0)
     {
-        // Creates the message queues (in/out) for the tasks:
-        m_input_queue.reset(IMessageQueue::create(task_capacity));
-        m_output_queue.reset(IMessageQueue::create());
+        // Locked before the allocations of the pool, that are locked too:
+        if (options.lock_memory && 0 != ::mlockall(MCL_CURRENT | MCL_FUTURE))
+        {
+            TRACE_WARNING(TRACE_CATEGORY_POOL, "Memory not locked");
+        }
+
+        // Creates the input queue and the output buffers for the tasks, one
+        // for each worker and each spare thread:
+        m_input_queue.reset(IMessageQueue::create(options.task_capacity,
+                                                  options.wait_strategy));
+        m_completions.reset(new ThreadPoolCompletions(
+                options.num_threads + options.max_spare_threads,
+                options.wait_strategy));
+
+        if (options.max_spare_threads > 0)
+        {
+            m_spares.reset(new ThreadPoolSpares(*m_input_queue,
+                                                *m_completions,
+                                                m_timeline.get(),
+                                                options));
+        }
 
         // Creates the threads:
-        m_threads.reserve(num_threads);
-        for (std::size_t i = 0; i < num_threads; ++i)
+        m_threads.reserve(options.num_threads);
+        m_counters.reserve(options.num_threads);
+        for (std::size_t i = 0; i < options.num_threads; ++i)
         {
+            m_counters.emplace_back(new ThreadPoolWorkerCounters());
+
             Task worker(new ThreadPoolWorker(*m_input_queue,
-                                             *m_output_queue));
+                                             *m_completions,
+                                             std::uint32_t(i),
+                                             m_timeline.get(),
+                                             *m_counters.back(),
+                                             options,
+                                             m_spares.get(),
+                                             false));
 
             Thread thread_worker(IThread::create(worker));
             m_threads.push_back(thread_worker);
@@ -122,10 +1064,33 @@ public:
     {
         // Precondition verification:
         assert(nullptr != task.get());
-        assert(!m_cancelled);
 
-        // Tries to push the task in the form of message to the input queue:
-        return m_input_queue->push(task);
+        task->m_deadline_ns = 0;
+
+        return submit(task);
+    }
+
+    virtual std::size_t
+    push(Task task, std::uint64_t deadline_ns)
+    {
+        // Precondition verification:
+        assert(nullptr != task.get());
+        assert(0 != deadline_ns);
+
+        task->m_deadline_ns = deadline_ns;
+
+        return submit(task);
+    }
+
+    virtual std::size_t
+    post(Task task)
+    {
+        // Precondition verification:
+        assert(nullptr != task.get());
+
+        task->m_detached = true;
+
+        return push(task);
     }
 
     virtual std::size_t
@@ -135,12 +1100,24 @@ public:
         assert(!m_cancelled);
 
         // Fetches the next executed task in the form of message:
-        return m_output_queue->popT(task, blocking);
+        return m_completions->pop(task, blocking);
+    }
+
+    virtual std::size_t
+    pop_all(std::deque<Task> &tasks, std::size_t max_count, bool blocking)
+    {
+        // Precondition verification:
+        assert(!m_cancelled);
+
+        return m_completions->pop_all(tasks, max_count, blocking);
     }
 
     virtual void
     cancel()
     {
+        // Closed first, so that the tasks pushed from now on (for example by
+        // the running ones) are rejected:
+        m_input_queue->close();
         m_input_queue->cancel();
         m_cancelled = true;
     }
@@ -148,6 +1125,27 @@ public:
     virtual void
     join()
     {
+        shutdown(SHUTDOWN_ABORT);
+    }
+
+    virtual void
+    shutdown(ShutdownMode mode)
+    {
+        if (SHUTDOWN_DRAIN == mode && !m_cancelled)
+        {
+            // The workers terminate once the input queue is empty:
+            m_input_queue->close();
+
+            for (auto &thread: m_threads)
+            {
+                thread->join();
+            }
+            join_spares();
+
+            m_completions->finish();
+            return;
+        }
+
         // Cancel the input queue in order to terminate all workers:
         cancel();
 
@@ -156,12 +1154,253 @@ public:
         {
             thread->join();
         }
+        join_spares();
 
-        // Transfers all pending tasks from the input queue to the output one:
+        // Cancels all pending tasks and transfers them from the input queue
+        // to the executed ones, but the posted ones that are not collected:
         Task task;
         while (m_input_queue->popT(task, false) > 0)
         {
-            m_output_queue->push(task);
+            ThreadPoolWorker::cancel_task(*task);
+            if (!task->m_detached)
+            {
+                m_completions->push_merged(task);
+            }
+        }
+
+        m_completions->finish();
+    }
+
+    virtual bool
+    is_closed() const
+    {
+        return m_cancelled || m_input_queue->is_closed();
+    }
+
+    virtual int
+    readiness_fd()
+    {
+        return m_completions->readiness_fd();
+    }
+
+    virtual void
+    clear_readiness()
+    {
+        m_completions->clear_readiness();
+    }
+
+    virtual void
+    stats(ThreadPoolStats &dst) const
+    {
+        MessageQueueStats queue_stats;
+        m_input_queue->stats(queue_stats);
+
+        dst.submitted = queue_stats.pushed;
+        dst.rejected = m_rejected.load(std::memory_order_relaxed);
+        dst.blocked = m_blocked.load(std::memory_order_relaxed);
+        dst.caller_runs = m_caller_runs.load(std::memory_order_relaxed);
+        dst.dropped = m_dropped.load(std::memory_order_relaxed);
+        dst.queue_size = queue_stats.size;
+        dst.queue_high_watermark = queue_stats.high_watermark;
+        dst.completed = 0;
+        dst.failed = 0;
+        dst.cancelled = 0;
+        dst.expired = 0;
+        dst.missed = 0;
+        dst.spawned = 0;
+        dst.workers.resize(m_counters.size());
+        dst.queue_wait = HistogramSnapshot();
+        dst.execution = HistogramSnapshot();
+
+        std::uint64_t now = clock_now_ns();
+        for (std::size_t i = 0; i < m_counters.size(); ++i)
+        {
+            add_stats(*m_counters[i], now, dst.workers[i], dst);
+        }
+
+        // The spare threads count into the totals only:
+        if (m_spares)
+        {
+            ThreadPoolWorkerStats spare;
+            for (auto &counters: m_spares->counters())
+            {
+                add_stats(*counters, now, spare, dst);
+            }
+            dst.spawned = m_spares->spawned();
+        }
+    }
+
+private:
+
+    // Takes a snapshot of the counters of a worker and adds it to the
+    // totals:
+    static void
+    add_stats(const ThreadPoolWorkerCounters &counters,
+              std::uint64_t now,
+              ThreadPoolWorkerStats &worker,
+              ThreadPoolStats &dst)
+    {
+        counters.snapshot(worker, now);
+        dst.completed += worker.executed;
+        dst.failed += worker.failed;
+        dst.cancelled += worker.cancelled;
+        dst.expired += worker.expired;
+        dst.missed += worker.missed;
+        dst.submitted += worker.local;
+
+        HistogramSnapshot histogram;
+        counters.m_queue_wait.snapshot(histogram);
+        dst.queue_wait.merge(histogram);
+
+        counters.m_execution.snapshot(histogram);
+        dst.execution.merge(histogram);
+    }
+
+    void
+    join_spares()
+    {
+        if (m_spares)
+        {
+            m_spares->join();
+        }
+    }
+
+    std::size_t
+    submit(Task task)
+    {
+        task->m_enqueued_ns = clock_now_ns();
+
+        // Submitted by a task running on one of the workers:
+        if (m_local_slot
+                && 0 == task->m_deadline_ns
+                && !m_input_queue->is_closed())
+        {
+            ThreadPoolWorker *worker = ThreadPoolWorker::current(
+                    *m_input_queue);
+            if (nullptr != worker && push_local(*worker, task))
+            {
+                return m_input_queue->size() + 1;
+            }
+        }
+
+        // Tries to push the task in the form of message to the input queue:
+        std::size_t ret = enqueue(task, false);
+        if (0 == ret && !m_input_queue->is_closed() && !task->m_internal)
+        {
+            ret = push_full(task);
+        }
+
+        if (0 == ret)
+        {
+            m_rejected.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        return ret;
+    }
+
+    // Puts the task into the local slot of the worker, the task it replaces
+    // moves to the shared queue if there is room for it:
+    bool
+    push_local(ThreadPoolWorker &worker, Task task)
+    {
+        Task replaced = worker.exchange_local(task);
+        if (replaced && 0 == enqueue(replaced, false))
+        {
+            worker.exchange_local(replaced);
+            return false;
+        }
+
+        return true;
+    }
+
+    // The tasks with a deadline are queued earliest-deadline-first ahead of
+    // the other ones:
+    std::size_t
+    enqueue(Task task, bool blocking)
+    {
+        if (0 != task->m_deadline_ns)
+        {
+            return m_input_queue->push_ordered(task, task->m_deadline_ns,
+                                               blocking);
+        }
+
+        return m_input_queue->push(task, blocking);
+    }
+
+    // The activations of the schedulers built on the pool are never
+    // dropped:
+    static bool
+    is_droppable(const IMessage &message)
+    {
+        return !static_cast<const ITask &>(message).m_internal;
+    }
+
+    // Applies the rejection policy to a task pushed while the input queue is
+    // full, returns zero if the task has not been accepted:
+    std::size_t
+    push_full(Task task)
+    {
+        switch (m_rejection_policy)
+        {
+        case ThreadPoolOptions::REJECT_BLOCK:
+            m_blocked.fetch_add(1, std::memory_order_relaxed);
+            return enqueue(task, true);
+
+        case ThreadPoolOptions::REJECT_CALLER_RUNS:
+            m_caller_runs.fetch_add(1, std::memory_order_relaxed);
+            if (task->is_cancelled())
+            {
+                ThreadPoolWorker::cancel_task(*task);
+            }
+            else
+            {
+                ThreadPoolWorker::execute_task(*task);
+            }
+            if (!task->m_detached)
+            {
+                m_completions->push_merged(task);
+            }
+            return std::max<std::size_t>(m_input_queue->size(), 1);
+
+        case ThreadPoolOptions::REJECT_DROP_NEWEST:
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            ThreadPoolWorker::cancel_task(*task);
+            return 0;
+
+        case ThreadPoolOptions::REJECT_DROP_OLDEST:
+            for (;;)
+            {
+                // The workers may have made room meanwhile:
+                Task oldest;
+                bool evicted = m_input_queue->evictT(oldest, is_droppable) > 0;
+                if (evicted)
+                {
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    ThreadPoolWorker::cancel_task(*oldest);
+                    if (!oldest->m_detached)
+                    {
+                        m_completions->push_merged(oldest);
+                    }
+                }
+
+                std::size_t ret = enqueue(task, false);
+                if (ret > 0 || m_input_queue->is_closed())
+                {
+                    return ret;
+                }
+
+                // Nothing but activations queued, drops the newest instead:
+                if (!evicted)
+                {
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    ThreadPoolWorker::cancel_task(*task);
+                    return 0;
+                }
+            }
+
+        case ThreadPoolOptions::REJECT_FAIL:
+        default:
+            return 0;
         }
     }
 
@@ -173,7 +1412,15 @@ IThreadPool *
 IThreadPool::create(std::size_t num_threads,
                     std::size_t task_capacity)
 {
-    return new ThreadPoolPosix(num_threads, task_capacity);
+    return new ThreadPoolPosix(ThreadPoolOptions(num_threads, task_capacity));
+}
+
+// -----------------------------------------------------------------------------
+
+IThreadPool *
+IThreadPool::create(const ThreadPoolOptions &options)
+{
+    return new ThreadPoolPosix(options);
 }
 
 // -----------------------------------------------------------------------------
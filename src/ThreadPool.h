@@ -30,12 +30,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef TTHREADPOOL_H
 #define TTHREADPOOL_H
 
+#include "Histogram.h"
 #include "MessageQueue.h"
 #include "Task.h"
+#include "TaskTimeline.h"
+#include "WaitStrategy.h"
 
 #include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <limits>
 #include <memory>
+#include <vector>
 
 // ----------------------------------------------------------------------------
 
@@ -50,6 +56,338 @@ class IThreadPool;
  */
 typedef std::shared_ptr<IThreadPool> ThreadPool;
 
+/**
+ * @brief Parameters to create a thread pool (see @ref
+ * IThreadPool::create(const ThreadPoolOptions &)).
+ *
+ * @ingroup threading-high
+ */
+struct ThreadPoolOptions
+{
+    /**
+     * @brief What the pool does with a task pushed while its queue is full
+     * (see @ref IThreadPool::push).
+     */
+    enum RejectionPolicy
+    {
+        /**
+         * @brief The push fails and returns @a zero.
+         */
+        REJECT_FAIL,
+
+        /**
+         * @brief The push blocks the caller until a worker makes room for
+         * the task or until the pool is closed.
+         */
+        REJECT_BLOCK,
+
+        /**
+         * @brief The task is executed by the calling thread before the push
+         * returns, which slows down the producers as much as the workers
+         * are behind.
+         */
+        REJECT_CALLER_RUNS,
+
+        /**
+         * @brief The pushed task is cancelled (see @ref ITask::cancel) and
+         * the push returns @a zero.
+         */
+        REJECT_DROP_NEWEST,
+
+        /**
+         * @brief The oldest queued task is cancelled to make room for the
+         * pushed one. The tasks with a deadline go last, the one with the
+         * latest deadline first (see @ref IMessageQueue::evict).
+         */
+        REJECT_DROP_OLDEST
+    };
+
+    /**
+     * @brief The number of threads the pool should use concurrently.
+     */
+    std::size_t num_threads;
+
+    /**
+     * @brief Maximum number of tasks that can be queued at the same time
+     * before their execution.
+     */
+    std::size_t task_capacity;
+
+    /**
+     * @brief Optional recorder of the executed tasks.
+     *
+     * When set, every worker records the enqueue, start and finish time of
+     * each task it executes.
+     */
+    std::shared_ptr<TaskTimeline> timeline;
+
+    /**
+     * @brief What to do with the tasks pushed while the pool is full, by
+     * default the push fails.
+     *
+     * The activations of the schedulers built on the pool (@ref Actor,
+     * @ref Strand, @ref FairScheduler) always fail instead, and retry.
+     */
+    RejectionPolicy rejection_policy;
+
+    /**
+     * @brief When set, the tasks whose deadline is already over when a
+     * worker fetches them are cancelled instead of executed (see @ref
+     * IThreadPool::push(Task, std::uint64_t)).
+     */
+    bool drop_expired;
+
+    /**
+     * @brief When set, a task pushed by a task running on the pool (without
+     * a deadline) goes into the local slot of its worker and runs right
+     * after the current one, on the same thread and with warm caches; the
+     * task it replaces into the slot moves to the shared queue. The tasks
+     * pushed from the outside keep their FIFO order.
+     *
+     * A task must not wait for a task it has pushed: nothing but its worker
+     * runs the task of the slot.
+     */
+    bool local_slot;
+
+    /**
+     * @brief How an idle worker, and a caller blocked on @ref
+     * IThreadPool::pop, polls for work before parking. By default they park
+     * immediately.
+     */
+    WaitStrategy wait_strategy;
+
+    /**
+     * @brief Processors the workers are bound to (see @ref
+     * IThread::set_affinity): worker @a i runs on processor @a cpus[i %
+     * cpus.size()]. By default the workers are not bound.
+     */
+    std::vector<std::size_t> cpus;
+
+    /**
+     * @brief When set, the pool locks the memory of the process (present
+     * and future) into RAM and each worker touches its stack before serving
+     * any task, so that no page fault hits the tasks after the warm-up.
+     *
+     * Locking the memory affects the whole process and usually requires a
+     * privilege or a raised @a RLIMIT_MEMLOCK; on failure the pool traces a
+     * warning and keeps going. The memory stays locked after the pool is
+     * destroyed: the pool can't tell whether the application wants it
+     * locked for other reasons, so it never unlocks it.
+     */
+    bool lock_memory;
+
+    /**
+     * @brief Greatest number of spare threads the pool starts to stand in
+     * for the tasks blocked inside a @ref BlockingRegion, so that the tasks
+     * still queued keep running on @ref num_threads threads. By default no
+     * spare thread is started and the regions have no effect.
+     */
+    std::size_t max_spare_threads;
+
+    /**
+     * @brief Constructor.
+     *
+     * @param num_threads The number of threads the pool should use
+     *        concurrently.
+     *
+     * @param task_capacity Maximum number of tasks that can be queued at the
+     *        same time before their execution. By default this limit is
+     *        relaxed as much as possible.
+     */
+    explicit ThreadPoolOptions(std::size_t num_threads,
+                               std::size_t task_capacity
+                               = std::numeric_limits<std::size_t>::max())
+            : num_threads(num_threads),
+              task_capacity(task_capacity),
+              rejection_policy(REJECT_FAIL),
+              drop_expired(false),
+              local_slot(false),
+              lock_memory(false),
+              max_spare_threads(0)
+    {
+    }
+
+    /**
+     * @brief Returns the options of a pool dedicated to latency critical
+     * tasks.
+     *
+     * The pool has one worker bound to each of the given processors, which
+     * should be isolated from the other threads of the system. The workers
+     * never park while waiting for tasks (nor do the callers blocked on
+     * @ref IThreadPool::pop), and the memory of the process is locked for
+     * good (see @ref lock_memory).
+     *
+     * @param cpus Processors reserved to the pool, one for each worker.
+     *
+     * @param task_capacity Maximum number of tasks that can be queued at the
+     *        same time before their execution.
+     *
+     * @return The options, to be passed to @ref IThreadPool::create.
+     */
+    static ThreadPoolOptions low_latency(const std::vector<std::size_t> &cpus,
+                                         std::size_t task_capacity
+                                         = std::numeric_limits<
+                                                 std::size_t>::max())
+    {
+        ThreadPoolOptions options(cpus.size(), task_capacity);
+        options.wait_strategy = WaitStrategy(
+                0, std::numeric_limits<std::size_t>::max(), 0);
+        options.cpus = cpus;
+        options.lock_memory = true;
+
+        return options;
+    }
+};
+
+/**
+ * @brief Snapshot of the activity of one worker of a thread pool.
+ *
+ * @ingroup threading-high
+ */
+struct ThreadPoolWorkerStats
+{
+    std::uint64_t executed;  ///< Number of tasks executed.
+    std::uint64_t failed;    ///< Number of tasks that threw an exception.
+    std::uint64_t cancelled; ///< Number of cancelled tasks skipped.
+    std::uint64_t expired;   ///< Number of expired tasks skipped.
+    std::uint64_t missed;    ///< Number of tasks finished past deadline.
+    std::uint64_t local;     ///< Number of tasks run from the local slot.
+    std::uint64_t busy_ns;   ///< Time spent executing tasks.
+    std::uint64_t idle_ns;   ///< Time spent waiting for tasks.
+
+    ThreadPoolWorkerStats()
+            : executed(0),
+              failed(0),
+              cancelled(0),
+              expired(0),
+              missed(0),
+              local(0),
+              busy_ns(0),
+              idle_ns(0)
+    {
+    }
+};
+
+/**
+ * @brief Snapshot of the counters of a thread pool (see @ref
+ * IThreadPool::stats).
+ *
+ * @ingroup threading-high
+ */
+struct ThreadPoolStats
+{
+    /**
+     * @brief Number of tasks successfully pushed.
+     */
+    std::uint64_t submitted;
+
+    /**
+     * @brief Number of pushes that failed because the pool was full or
+     * closed.
+     */
+    std::uint64_t rejected;
+
+    /**
+     * @brief Number of pushes that waited for room in the queue (see @ref
+     * ThreadPoolOptions::REJECT_BLOCK).
+     */
+    std::uint64_t blocked;
+
+    /**
+     * @brief Number of tasks executed by the pushing thread because the pool
+     * was full (see @ref ThreadPoolOptions::REJECT_CALLER_RUNS).
+     */
+    std::uint64_t caller_runs;
+
+    /**
+     * @brief Number of tasks cancelled to bound the queue (see @ref
+     * ThreadPoolOptions::REJECT_DROP_NEWEST and @ref
+     * ThreadPoolOptions::REJECT_DROP_OLDEST).
+     */
+    std::uint64_t dropped;
+
+    /**
+     * @brief Number of tasks executed.
+     */
+    std::uint64_t completed;
+
+    /**
+     * @brief Number of executed tasks that threw an exception (see @ref
+     * ITask::has_failed).
+     */
+    std::uint64_t failed;
+
+    /**
+     * @brief Number of tasks skipped by the workers because they have been
+     * cancelled while queued (see @ref ITask::set_cancellation_token).
+     */
+    std::uint64_t cancelled;
+
+    /**
+     * @brief Number of tasks skipped by the workers because their deadline
+     * was over (see @ref ThreadPoolOptions::drop_expired).
+     */
+    std::uint64_t expired;
+
+    /**
+     * @brief Number of executed tasks that finished after their deadline.
+     */
+    std::uint64_t missed;
+
+    /**
+     * @brief Number of spare threads started to stand in for blocked tasks
+     * (see @ref BlockingRegion).
+     */
+    std::uint64_t spawned;
+
+    /**
+     * @brief Number of tasks waiting to be executed.
+     */
+    std::size_t queue_size;
+
+    /**
+     * @brief Greatest number of tasks waiting to be executed at the same
+     * time.
+     */
+    std::size_t queue_high_watermark;
+
+    /**
+     * @brief Activity of each worker, the spare threads excluded (their
+     * tasks are counted by the totals above).
+     */
+    std::vector<ThreadPoolWorkerStats> workers;
+
+    /**
+     * @brief Distribution of the time (nanoseconds) spent by the tasks
+     * between their submission and the start of their execution.
+     */
+    HistogramSnapshot queue_wait;
+
+    /**
+     * @brief Distribution of the execution time (nanoseconds) of the tasks.
+     */
+    HistogramSnapshot execution;
+
+    ThreadPoolStats()
+            : submitted(0),
+              rejected(0),
+              blocked(0),
+              caller_runs(0),
+              dropped(0),
+              completed(0),
+              failed(0),
+              cancelled(0),
+              expired(0),
+              missed(0),
+              spawned(0),
+              queue_size(0),
+              queue_high_watermark(0)
+    {
+    }
+};
+
+// ----------------------------------------------------------------------------
+
 /**
  * @brief General purpose thread pool for inter-thread communication.
  *
@@ -66,6 +404,25 @@ class IThreadPool
 
 public:
 
+    /**
+     * @brief How the pool treats the tasks still queued when shutting down
+     * (see method @ref shutdown).
+     */
+    enum ShutdownMode
+    {
+        /**
+         * @brief Stops accepting new tasks but executes all the queued ones
+         * before terminating the threads.
+         */
+        SHUTDOWN_DRAIN,
+
+        /**
+         * @brief Terminates the threads as soon as the running tasks are
+         * over; the queued tasks are not executed (see method @ref cancel).
+         */
+        SHUTDOWN_ABORT
+    };
+
     /**
      * @brief Factory method to create a thread pool implemented for the current
      * platform.
@@ -82,6 +439,17 @@ public:
     static IThreadPool *create(std::size_t num_threads,
                                std::size_t task_capacity
                                = std::numeric_limits<std::size_t>::max());
+
+    /**
+     * @brief Factory method to create a thread pool implemented for the current
+     * platform.
+     *
+     * @param options The parameters of the pool.
+     *
+     * @return The newly created thread pool.
+     */
+    static IThreadPool *create(const ThreadPoolOptions &options);
+
     /**
      * @brief Destructor.
      */
@@ -91,19 +459,81 @@ public:
     /**
      * @brief Pushes one task into the pool.
      *
+     * If the execution of the task throws an exception, the exception is
+     * caught and attached to the task (see @ref ITask::has_failed) and the
+     * worker keeps serving the pool.
+     *
+     * If the task is cancelled (see @ref ITask::is_cancelled) before a worker
+     * fetches it, the worker calls @ref ITask::cancel in place of @ref
+     * ITask::execute and the task is popped as any other.
+     *
+     * When the maximum allowed capacity for pending tasks have been reached
+     * the task is handled according to the rejection policy of the pool (see
+     * @ref ThreadPoolOptions::rejection_policy).
+     *
+     * @param task The task to be inserted.
+     *
+     * @return
+     * - On success, the number of tasks pending to be executed after the
+     *   insertion, that is at least @a one. A task executed by the calling
+     *   thread counts as a success.
+     * - On failure, @a zero. This may happen if the pool is full and its
+     *   policy fails or drops the new task, or if the pool have been
+     *   cancelled or shut down.
+     *
+     * @pre
+     * - The parameter task is not null.
+     */
+    virtual std::size_t push(Task task) = 0;
+
+    /**
+     * @brief Pushes one task with a deadline into the pool.
+     *
+     * The tasks with a deadline are executed before the ones without,
+     * earliest deadline first. If the pool drops the expired tasks (see
+     * @ref ThreadPoolOptions::drop_expired) and the deadline is over when a
+     * worker fetches the task, the task is cancelled instead of executed.
+     *
+     * @warning A task without a deadline is fetched from the shared queue
+     * only once no task with a deadline is queued, whatever the deadlines: a
+     * steady stream of tasks with a deadline starves the tasks without one
+     * indefinitely.
+     *
+     * @param task The task to be inserted.
+     *
+     * @param deadline_ns The time (see @ref clock_now_ns) by which the task
+     *        should be finished.
+     *
+     * @return The same as @ref push(Task).
+     *
+     * @pre
+     * - The parameter task is not null.
+     * - The parameter deadline_ns is not @a zero.
+     */
+    virtual std::size_t push(Task task, std::uint64_t deadline_ns) = 0;
+
+    /**
+     * @brief Pushes one task into the pool without collecting it afterwards.
+     *
+     * The task is executed like the ones inserted with @ref push but it is
+     * released by the worker as soon as its execution is over instead of
+     * being queued on the list of the executed ones (see method @ref pop).
+     * If the pool is joined before its execution the task is cancelled (see
+     * method @ref ITask::cancel) and released.
+     *
      * @param task The task to be inserted.
      *
      * @return
      * - On success, the number of tasks pending to be executed after the
      *   insertion, that is at least @a one.
      * - On failure, @a zero. This may happen if the maximum allowed capacity
-     *   for pending tasks have been reached.
+     *   for pending tasks have been reached or if the pool have been
+     *   cancelled or shut down.
      *
      * @pre
      * - The parameter task is not null.
-     * - The pool have not been cancelled.
      */
-    virtual std::size_t push(Task task) = 0;
+    virtual std::size_t post(Task task) = 0;
 
     /**
      * @brief Pops one executed/cancelled task from the pool.
@@ -111,9 +541,13 @@ public:
      * @param[out] task Smart pointer that will be reset with the popped
      *             task in case of success.
      *
+     * Each worker buffers the tasks it executes on its own, the buffers are
+     * merged only when the tasks are popped: the tasks are popped in their
+     * order of completion.
+     *
      * @param blocking If set to @a true the method blocks the current thread
      *        indefinitely until a new task have been executed or the pool
-     *        have been cancelled.
+     *        have been shut down.
      *
      * @return
      * - On success, the number of tasks already completed not yet popped
@@ -125,11 +559,35 @@ public:
      */
     virtual std::size_t pop(Task &task, bool blocking) = 0;
 
+    /**
+     * @brief Pops many executed/cancelled tasks from the pool at once.
+     *
+     * The tasks are extracted in their order of completion, collecting the
+     * tasks of all the workers with one lock acquisition for each worker
+     * that executed some.
+     *
+     * @param[out] tasks Container the popped tasks are appended to.
+     *
+     * @param max_count Maximum number of tasks to be popped.
+     *
+     * @param blocking If set to @a true the method blocks the current thread
+     *        like @ref pop until at least one task can be popped.
+     *
+     * @return The number of popped tasks, @a zero if none.
+     *
+     * @pre
+     * - The pool have not been cancelled.
+     */
+    virtual std::size_t pop_all(std::deque<Task> &tasks,
+                                std::size_t max_count,
+                                bool blocking) = 0;
+
     /**
      * @brief Cancel the pool functionality indefinitely releasing any thread.
      *
-     * Also cancel any task that have not yet executed. Those task are queued
-     * on the list of executed one and can be popped (see method @ref pop).
+     * Also cancel any task that have not yet executed (see @ref
+     * ITask::cancel). Those task are queued on the list of executed one and
+     * can be popped (see method @ref pop).
      *
      * The cancelled status is not reversible and is meant mainly as an action
      * to be performed before the pool destruction.
@@ -143,7 +601,7 @@ public:
      * @brief Cancel and wait for the termination of pool's threads.
      *
      * This method calls the method @ref cancel and than waits indefinitely for
-     * the pool's threads.
+     * the pool's threads, like @ref shutdown with @ref SHUTDOWN_ABORT.
      *
      * @pre
      * - The behaviour of this method if called during the task execution is
@@ -151,6 +609,60 @@ public:
      */
     virtual void join() = 0;
 
+    /**
+     * @brief Stops accepting tasks and waits for the termination of pool's
+     * threads.
+     *
+     * @param mode With @ref SHUTDOWN_DRAIN every task already queued is
+     *        executed before the threads terminate and the pool is not
+     *        cancelled, so the executed tasks can still be popped (see
+     *        method @ref pop). With @ref SHUTDOWN_ABORT the method behaves
+     *        like @ref join.
+     *
+     * @pre
+     * - The behaviour of this method if called during the task execution is
+     *   undefined.
+     */
+    virtual void shutdown(ShutdownMode mode) = 0;
+
+    /**
+     * @brief Returns @a true if the pool doesn't accept tasks any more
+     * because it have been cancelled or shut down.
+     */
+    virtual bool is_closed() const = 0;
+
+    /**
+     * @brief Copies the counters of the pool.
+     *
+     * Counters are maintained with lock-free operations and read without
+     * blocking neither the workers nor the producers, hence they may be
+     * slightly out of sync with each other.
+     */
+    virtual void stats(ThreadPoolStats &dst) const = 0;
+
+    /**
+     * @brief Returns a file descriptor that becomes readable when executed
+     * tasks are ready to be popped, to wait for them into a @a poll, @a epoll
+     * or @a select loop.
+     *
+     * Once the descriptor is reported readable the consumer calls @ref
+     * clear_readiness and then pops (without blocking) until no task is
+     * left (see @ref IMessageQueue::readiness_fd).
+     *
+     * @return The descriptor, owned by the pool: it must not be read or
+     *         closed by the user.
+     */
+    virtual int readiness_fd() = 0;
+
+    /**
+     * @brief Makes the descriptor returned by @ref readiness_fd non readable,
+     * to be called before popping the executed tasks.
+     *
+     * @pre
+     * - The method @ref readiness_fd have already been called.
+     */
+    virtual void clear_readiness() = 0;
+
     /**
      * @brief Convenient template method to pop executed tasks.
      *
@@ -181,4 +693,50 @@ public:
 
 };
 
+// ----------------------------------------------------------------------------
+
+class ThreadPoolSpares;
+
+/**
+ * @brief Marks a section of a task that blocks for reasons other than the
+ * CPU (file I/O, waits for other threads...).
+ *
+ * While the region lasts the pool may run the queued tasks on a spare
+ * thread (see @ref ThreadPoolOptions::max_spare_threads), so that a pool
+ * sized to the processors keeps them busy. The spare thread retires after
+ * the task it's running when the region ends.
+ *
+ * A region created by a thread that isn't running a task of a pool has no
+ * effect.
+ *
+ * @see @ref RAII "Resource Acquisition Is Initialization"
+ *
+ * @ingroup raii
+ */
+class BlockingRegion
+{
+
+public:
+
+    /**
+     * @brief Enters the region, a spare thread may start.
+     */
+    BlockingRegion();
+
+    /**
+     * @brief Destructor.
+     *
+     * Leaves the region, a spare thread retires as soon as it's idle.
+     */
+    ~BlockingRegion();
+
+private:
+
+    ThreadPoolSpares *m_spares;
+
+    BlockingRegion(const BlockingRegion &);
+    BlockingRegion &operator=(const BlockingRegion &);
+
+};
+
 #endif // TTHREADPOOL_H
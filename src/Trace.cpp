@@ -29,24 +29,317 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "Trace.h"
 
+#include "Clock.h"
 #include "Mutex.h"
+#include "Thread.h"
 
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <vector>
+
+#include <time.h>
+#include <unistd.h>
 
 // -----------------------------------------------------------------------------
 
 namespace
 {
     volatile bool is_active = false;
-    Mutex mutex;
+
+    std::atomic<bool> is_binary_active(false);
+
+    const std::size_t CACHE_LINE_SIZE = 64;
+
+// -----------------------------------------------------------------------------
+
+/**
+ * Single-producer/single-consumer ring buffer: the producer is the owner
+ * thread, the consumer is the background writer.
+ */
+class TraceBuffer
+{
+
+public:
+
+    TraceBuffer()
+            : m_released(false),
+              m_head(0),
+              m_tail(0),
+              m_cached_head(0)
+    {
+    }
+
+    // Producer side, never blocks:
+    bool
+    push(const TraceRecord &record)
+    {
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cached_head >= TRACE_BUFFER_CAPACITY)
+        {
+            m_cached_head = m_head.load(std::memory_order_acquire);
+            if (tail - m_cached_head >= TRACE_BUFFER_CAPACITY)
+            {
+                return false;
+            }
+        }
+
+        m_records[tail % TRACE_BUFFER_CAPACITY] = record;
+        m_tail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Consumer side, writes the buffered records into the file (or discards
+    // them if the file is null):
+    std::size_t
+    drain(std::FILE *file)
+    {
+        std::size_t head = m_head.load(std::memory_order_relaxed);
+        std::size_t tail = m_tail.load(std::memory_order_acquire);
+        std::size_t count = tail - head;
+
+        while (file != nullptr && head != tail)
+        {
+            std::size_t begin = head % TRACE_BUFFER_CAPACITY;
+            std::size_t chunk = std::min(tail - head,
+                                         TRACE_BUFFER_CAPACITY - begin);
+            std::fwrite(&m_records[begin], sizeof(TraceRecord), chunk, file);
+            head += chunk;
+        }
+
+        m_head.store(tail, std::memory_order_release);
+
+        return count;
+    }
+
+    bool
+    is_empty() const
+    {
+        return m_head.load(std::memory_order_acquire)
+               == m_tail.load(std::memory_order_acquire);
+    }
+
+    // Set when the owner thread terminates, the buffer can then be reused
+    // by another thread once drained:
+    std::atomic<bool> m_released;
+
+private:
+
+    // Consumer index, on its own cache line:
+    std::atomic<std::size_t> m_head;
+    char m_head_padding[CACHE_LINE_SIZE - sizeof(std::atomic<std::size_t>)];
+
+    // Producer indexes:
+    std::atomic<std::size_t> m_tail;
+    std::size_t m_cached_head;
+    char m_tail_padding[CACHE_LINE_SIZE - sizeof(std::atomic<std::size_t>)
+                        - sizeof(std::size_t)];
+
+    TraceRecord m_records[TRACE_BUFFER_CAPACITY];
+
+};
+
+// -----------------------------------------------------------------------------
+
+struct TraceState
+{
+    // Protects the list of buffers (buffers are never destroyed):
+    Mutex m_mutex;
+    std::vector<TraceBuffer *> m_buffers;
+
+    // Serializes trace_open and trace_close:
+    Mutex m_control;
+    std::FILE *m_file;
+    Thread m_writer;
+    std::atomic<bool> m_stopping;
+
+    std::atomic<std::uint64_t> m_dropped;
+    std::atomic<std::uint32_t> m_next_thread_id;
+
+    TraceState()
+            : m_file(nullptr),
+              m_stopping(false),
+              m_dropped(0),
+              m_next_thread_id(0)
+    {
+    }
+
+    void
+    buffers(std::vector<TraceBuffer *> &dst)
+    {
+        Locker<Mutex> locker(m_mutex);
+        dst = m_buffers;
+    }
+};
+
+// Intentionally never destroyed, threads can outlive static objects:
+TraceState &
+trace_state()
+{
+    static TraceState *state = new TraceState();
+    return *state;
+}
+
+// -----------------------------------------------------------------------------
+
+TraceBuffer *
+acquire_buffer()
+{
+    TraceState &state = trace_state();
+    Locker<Mutex> locker(state.m_mutex);
+
+    for (auto buffer: state.m_buffers)
+    {
+        if (buffer->m_released.load(std::memory_order_acquire)
+            && buffer->is_empty())
+        {
+            buffer->m_released.store(false, std::memory_order_relaxed);
+            return buffer;
+        }
+    }
+
+    state.m_buffers.push_back(new TraceBuffer());
+    return state.m_buffers.back();
+}
+
+// -----------------------------------------------------------------------------
+
+struct TraceThreadSlot
+{
+    TraceBuffer *m_buffer;
+    std::uint32_t m_thread_id;
+
+    TraceThreadSlot()
+            : m_buffer(nullptr),
+              m_thread_id(0)
+    {
+    }
+
+    ~TraceThreadSlot()
+    {
+        if (m_buffer != nullptr)
+        {
+            m_buffer->m_released.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local TraceThreadSlot thread_slot;
+
+// -----------------------------------------------------------------------------
+
+std::size_t
+drain_buffers(std::FILE *file)
+{
+    std::vector<TraceBuffer *> buffers;
+    trace_state().buffers(buffers);
+
+    std::size_t count = 0;
+    for (auto buffer: buffers)
+    {
+        count += buffer->drain(file);
+    }
+
+    return count;
 }
 
 // -----------------------------------------------------------------------------
 
+class TraceWriter
+        : public ITask
+{
+
+    std::FILE *m_file;
+
+public:
+
+    explicit TraceWriter(std::FILE *file)
+            : m_file(file)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        TraceState &state = trace_state();
+
+        while (!state.m_stopping.load(std::memory_order_acquire))
+        {
+            if (drain_buffers(m_file) > 0)
+            {
+                std::fflush(m_file);
+            }
+            else
+            {
+                struct timespec delay = { 0, 1000000 };
+                ::nanosleep(&delay, nullptr);
+            }
+        }
+
+        drain_buffers(m_file);
+        std::fflush(m_file);
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+void
+write_stderr(const std::string &line)
+{
+    // One single system call per line, no need to serialize the callers:
+    const char *data = line.data();
+    std::size_t size = line.size();
+    while (size > 0)
+    {
+        ssize_t written = ::write(STDERR_FILENO, data, size);
+        if (written <= 0)
+        {
+            break;
+        }
+
+        data += written;
+        size -= std::size_t(written);
+    }
+}
+
+} // anonymous namespace
+
+// -----------------------------------------------------------------------------
+
+std::atomic<std::uint32_t> trace_masks[TRACE_LEVEL_COUNT];
+
+// -----------------------------------------------------------------------------
+
 void
 trace_set(bool active)
 {
     is_active = active;
+    trace_enable(active ? TRACE_CATEGORY_ALL : 0, TRACE_LEVEL_DEBUG);
+}
+
+// -----------------------------------------------------------------------------
+
+void
+trace_enable(std::uint32_t categories, int min_level)
+{
+    for (int level = 0; level < TRACE_LEVEL_COUNT; ++level)
+    {
+        trace_masks[level].store(level >= min_level ? categories : 0,
+                                 std::memory_order_relaxed);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void
+trace_emit(int level, std::uint32_t category, const std::string &message)
+{
+    (void) level;
+    (void) category;
+
+    write_stderr(message + '\n');
 }
 
 // -----------------------------------------------------------------------------
@@ -56,8 +349,8 @@ trace(std::string message)
 {
     if (is_active)
     {
-        Locker<Mutex> locker(mutex);
-        std::cerr << message << std::endl;
+        message += '\n';
+        write_stderr(message);
     }
 }
 
@@ -68,9 +361,108 @@ trace(int id, std::string message)
 {
     if (is_active)
     {
-        Locker<Mutex> locker(mutex);
-        std::cerr << id << ": " << message << std::endl;
+        std::stringstream line;
+        line << id << ": " << message << '\n';
+        write_stderr(line.str());
     }
 }
 
 // -----------------------------------------------------------------------------
+
+bool
+trace_open(const char *path)
+{
+    assert(path != nullptr);
+
+    TraceState &state = trace_state();
+    Locker<Mutex> locker(state.m_control);
+
+    if (state.m_file != nullptr)
+    {
+        return false;
+    }
+
+    std::FILE *file = std::fopen(path, "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    std::fwrite(TRACE_FILE_MAGIC, 1, sizeof(TRACE_FILE_MAGIC) - 1, file);
+
+    // Discards the records left over by a previous session:
+    drain_buffers(nullptr);
+
+    state.m_file = file;
+    state.m_dropped.store(0, std::memory_order_relaxed);
+    state.m_stopping.store(false, std::memory_order_relaxed);
+    state.m_writer = IThread::create(std::make_shared<TraceWriter>(file));
+
+    is_binary_active.store(true, std::memory_order_release);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+void
+trace_close()
+{
+    TraceState &state = trace_state();
+    Locker<Mutex> locker(state.m_control);
+
+    if (state.m_file == nullptr)
+    {
+        return;
+    }
+
+    is_binary_active.store(false, std::memory_order_release);
+
+    state.m_stopping.store(true, std::memory_order_release);
+    state.m_writer->join();
+    state.m_writer.reset();
+
+    std::fclose(state.m_file);
+    state.m_file = nullptr;
+}
+
+// -----------------------------------------------------------------------------
+
+void
+trace_event(std::uint32_t event_id, std::uint64_t arg0, std::uint64_t arg1)
+{
+    if (!is_binary_active.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    TraceThreadSlot &slot = thread_slot;
+    if (slot.m_buffer == nullptr)
+    {
+        TraceState &state = trace_state();
+        slot.m_buffer = acquire_buffer();
+        slot.m_thread_id = state.m_next_thread_id.fetch_add(1) + 1;
+    }
+
+    TraceRecord record;
+    record.timestamp_ns = clock_now_ns();
+    record.thread_id = slot.m_thread_id;
+    record.event_id = event_id;
+    record.args[0] = arg0;
+    record.args[1] = arg1;
+
+    if (!slot.m_buffer->push(record))
+    {
+        trace_state().m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+std::uint64_t
+trace_dropped()
+{
+    return trace_state().m_dropped.load(std::memory_order_relaxed);
+}
+
+// -----------------------------------------------------------------------------
@@ -30,13 +30,144 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef TRACE_H
 #define TRACE_H
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <sstream>
 
 // -----------------------------------------------------------------------------
 
+/**
+ * @name Trace levels
+ * @{
+ */
+#define TRACE_LEVEL_DEBUG 0
+#define TRACE_LEVEL_INFO 1
+#define TRACE_LEVEL_WARNING 2
+#define TRACE_LEVEL_ERROR 3
+#define TRACE_LEVEL_COUNT 4
+/** @} */
+
+/**
+ * @brief Minimum level of the @ref TRACE macros compiled in the code.
+ *
+ * Macros for lower levels expand to nothing, their arguments are not even
+ * compiled. Can be overridden from the command line of the compiler (e.g.
+ * -DTRACE_MIN_LEVEL=TRACE_LEVEL_WARNING).
+ */
+#ifndef TRACE_MIN_LEVEL
+#define TRACE_MIN_LEVEL TRACE_LEVEL_DEBUG
+#endif
+
+/**
+ * @name Trace categories
+ *
+ * Bit masks to filter the messages at run-time (see @ref trace_enable).
+ * @{
+ */
+const std::uint32_t TRACE_CATEGORY_THREAD = 1u << 0;
+const std::uint32_t TRACE_CATEGORY_QUEUE = 1u << 1;
+const std::uint32_t TRACE_CATEGORY_POOL = 1u << 2;
+const std::uint32_t TRACE_CATEGORY_TEST = 1u << 3;
+const std::uint32_t TRACE_CATEGORY_USER = 1u << 16;
+const std::uint32_t TRACE_CATEGORY_ALL = 0xffffffffu;
+/** @} */
+
+/**
+ * @brief Categories enabled for each level, use @ref trace_is_enabled.
+ */
+extern std::atomic<std::uint32_t> trace_masks[TRACE_LEVEL_COUNT];
+
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Enables or disables all the messages of all categories and levels.
+ */
 void trace_set(bool active);
 
+/**
+ * @brief Enables only the messages of the passed categories having at least
+ * the passed level.
+ */
+void trace_enable(std::uint32_t categories, int min_level);
+
+/**
+ * @brief Returns @a true if messages of the passed level and category are
+ * enabled at run-time.
+ */
+inline bool
+trace_is_enabled(int level, std::uint32_t category)
+{
+    return (trace_masks[level].load(std::memory_order_relaxed) & category) != 0;
+}
+
+/**
+ * @brief Writes one message, use the @ref TRACE macros instead.
+ */
+void trace_emit(int level, std::uint32_t category, const std::string &message);
+
+/**
+ * @brief Traces a message built by streaming @a expression into a
+ * std::ostream.
+ *
+ * The expression is evaluated (and the message formatted) only if the
+ * category is enabled at run-time for the level (see @ref trace_enable):
+ *
+ * @code
+   TRACE(TRACE_LEVEL_INFO, TRACE_CATEGORY_POOL, "task " << id << " done");
+   @endcode
+ */
+#define TRACE(level, category, expression) \
+    do \
+    { \
+        if ((level) >= TRACE_MIN_LEVEL \
+            && trace_is_enabled((level), (category))) \
+        { \
+            std::ostringstream trace_builder_; \
+            trace_builder_ << expression; \
+            trace_emit((level), (category), trace_builder_.str()); \
+        } \
+    } while (false)
+
+/**
+ * @name Level specific trace macros
+ *
+ * Same as @ref TRACE, but stripped from the code if the level is lower than
+ * @ref TRACE_MIN_LEVEL.
+ * @{
+ */
+#if TRACE_MIN_LEVEL <= TRACE_LEVEL_DEBUG
+#define TRACE_DEBUG(category, expression) \
+    TRACE(TRACE_LEVEL_DEBUG, category, expression)
+#else
+#define TRACE_DEBUG(category, expression) do { } while (false)
+#endif
+
+#if TRACE_MIN_LEVEL <= TRACE_LEVEL_INFO
+#define TRACE_INFO(category, expression) \
+    TRACE(TRACE_LEVEL_INFO, category, expression)
+#else
+#define TRACE_INFO(category, expression) do { } while (false)
+#endif
+
+#if TRACE_MIN_LEVEL <= TRACE_LEVEL_WARNING
+#define TRACE_WARNING(category, expression) \
+    TRACE(TRACE_LEVEL_WARNING, category, expression)
+#else
+#define TRACE_WARNING(category, expression) do { } while (false)
+#endif
+
+#if TRACE_MIN_LEVEL <= TRACE_LEVEL_ERROR
+#define TRACE_ERROR(category, expression) \
+    TRACE(TRACE_LEVEL_ERROR, category, expression)
+#else
+#define TRACE_ERROR(category, expression) do { } while (false)
+#endif
+/** @} */
+
+// -----------------------------------------------------------------------------
+
 void trace(std::string message);
 
 void trace(int id, std::string message);
@@ -55,4 +186,67 @@ inline void trace(int id, std::stringstream& builder)
 
 // -----------------------------------------------------------------------------
 
+/**
+ * @brief One entry of a binary trace file (see @ref trace_open).
+ *
+ * The file starts with the 8 bytes @ref TRACE_FILE_MAGIC followed by the
+ * records, written in the native byte order.
+ */
+struct TraceRecord
+{
+    std::uint64_t timestamp_ns; ///< See @ref clock_now_ns.
+    std::uint32_t thread_id;    ///< Sequential number, one for each thread.
+    std::uint32_t event_id;     ///< As passed to @ref trace_event.
+    std::uint64_t args[2];      ///< As passed to @ref trace_event.
+};
+
+/**
+ * @brief Signature at the beginning of every binary trace file.
+ */
+#define TRACE_FILE_MAGIC "RRTRACE1"
+
+/**
+ * @brief Number of records each thread can buffer before the background
+ * writer drains them, records exceeding this limit are dropped.
+ */
+const std::size_t TRACE_BUFFER_CAPACITY = 8192;
+
+/**
+ * @brief Starts the binary tracing into the passed file.
+ *
+ * Every thread calling @ref trace_event appends records to its own lock-free
+ * ring buffer, a background thread periodically drains all the buffers into
+ * the file.
+ *
+ * @return @a false if the file cannot be created or the binary tracing is
+ *         already active.
+ */
+bool trace_open(const char *path);
+
+/**
+ * @brief Stops the binary tracing, writes the buffered records and closes
+ * the file.
+ */
+void trace_close();
+
+/**
+ * @brief Appends one record to the binary trace of the calling thread.
+ *
+ * Never blocks nor allocates (but the first time it's called by a thread
+ * while the binary tracing is active): if the buffer of the calling thread
+ * is full the record is dropped (see @ref trace_dropped). Does nothing if
+ * the binary tracing is not active.
+ */
+void trace_event(std::uint32_t event_id,
+                 std::uint64_t arg0 = 0,
+                 std::uint64_t arg1 = 0);
+
+/**
+ * @brief Returns the number of records dropped since the binary tracing has
+ * been opened.
+ */
+std::uint64_t trace_dropped();
+
+// -----------------------------------------------------------------------------
+
 #endif // TRACE_H
@@ -0,0 +1,160 @@
+/*
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef WAITSTRATEGY_H
+#define WAITSTRATEGY_H
+
+#include <cstddef>
+
+#include <sched.h>
+
+// ----------------------------------------------------------------------------
+
+/**
+ * @brief How a thread waiting for work polls before parking.
+ *
+ * Parking a thread on a condition variable costs nothing while idle, but
+ * the thread that wakes it up pays a system call and the parked thread
+ * pays the latency of the scheduler (tens of microseconds) before running
+ * again. A thread that keeps polling for a while instead sees the new work
+ * almost immediately, and the producer doesn't need to wake it up, at the
+ * price of the processor time spent polling.
+ *
+ * The waiting thread goes through the following phases, each one with its
+ * own budget of polls, and parks only once all of them are over:
+ * -# busy spin: polls in a tight loop;
+ * -# pause: polls separated by a pause instruction of the processor, that
+ *    saves power and leaves the pipeline to the sibling hyper-thread;
+ * -# yield: polls separated by a call to @a sched_yield, that leaves the
+ *    processor to the other runnable threads.
+ *
+ * The default strategy parks immediately. Spinning makes sense only when
+ * the waiting threads have a processor of their own.
+ *
+ * @ingroup threading-base
+ */
+struct WaitStrategy
+{
+    /**
+     * @brief Number of polls in a tight loop.
+     */
+    std::size_t spin;
+
+    /**
+     * @brief Number of polls separated by a pause of the processor.
+     */
+    std::size_t pause;
+
+    /**
+     * @brief Number of polls separated by a yield of the processor.
+     */
+    std::size_t yield;
+
+    /**
+     * @brief Constructor.
+     *
+     * @param spin Number of polls in a tight loop.
+     *
+     * @param pause Number of polls separated by a pause of the processor.
+     *
+     * @param yield Number of polls separated by a yield of the processor.
+     */
+    explicit WaitStrategy(std::size_t spin = 0,
+                          std::size_t pause = 0,
+                          std::size_t yield = 0)
+            : spin(spin),
+              pause(pause),
+              yield(yield)
+    {
+    }
+
+    /**
+     * @brief Returns @a true if the strategy parks without polling.
+     */
+    bool parks_immediately() const
+    {
+        return 0 == spin && 0 == pause && 0 == yield;
+    }
+
+    /**
+     * @brief Polls a condition according to the strategy.
+     *
+     * @param ready Callable returning @a true once the wait is over.
+     *
+     * @return @a true as soon as the condition holds, @a false once the
+     *         budget of polls is over and the caller should park.
+     */
+    template<typename Ready>
+    bool poll(Ready ready) const
+    {
+        for (std::size_t i = 0; i < spin; ++i)
+        {
+            if (ready())
+            {
+                return true;
+            }
+        }
+
+        for (std::size_t i = 0; i < pause; ++i)
+        {
+            cpu_pause();
+            if (ready())
+            {
+                return true;
+            }
+        }
+
+        for (std::size_t i = 0; i < yield; ++i)
+        {
+            ::sched_yield();
+            if (ready())
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Hints the processor that the calling thread is spinning.
+     */
+    static void cpu_pause()
+    {
+#if defined(__i386__) || defined(__x86_64__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+};
+
+// ----------------------------------------------------------------------------
+
+#endif // WAITSTRATEGY_H
@@ -0,0 +1,485 @@
+/**
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Actor.h"
+#include "test_Utils.h"
+
+#include "Strand.h"
+#include "Thread.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <sched.h>
+
+// -----------------------------------------------------------------------------
+
+namespace {
+
+class TestMessage
+        :
+                public IMailboxMessage
+{
+
+public:
+
+    int m_producer;
+    int m_sequence;
+
+    TestMessage(int producer, int sequence)
+            :
+            m_producer(producer),
+            m_sequence(sequence)
+    {
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+class TestProducerTask
+        :
+                public ITask
+{
+
+    Mailbox &m_mailbox;
+    int m_id;
+    int m_count;
+
+public:
+
+    TestProducerTask(Mailbox &mailbox, int id, int count)
+            :
+            m_mailbox(mailbox),
+            m_id(id),
+            m_count(count)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        for (int i = 0; i < m_count; ++i)
+        {
+            m_mailbox.push(std::make_shared<TestMessage>(m_id, i));
+        }
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+class TestCounterActor
+        :
+                public Actor
+{
+
+    std::atomic<int> &m_total;
+    std::atomic<int> m_active;
+
+public:
+
+    int m_received;
+    bool m_exclusive;
+
+    TestCounterActor(IThreadPool &pool, std::atomic<int> &total)
+            :
+            Actor(pool, 4),
+            m_total(total),
+            m_active(0),
+            m_received(0),
+            m_exclusive(true)
+    {
+    }
+
+protected:
+
+    virtual void
+    receive(MailboxMessage message)
+    {
+        (void) message;
+
+        m_exclusive = m_exclusive && (0 == m_active.fetch_add(1));
+        ++m_received;
+        m_active.fetch_sub(1);
+
+        m_total.fetch_add(1);
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+void
+test_mailbox()
+{
+    const int NUM_PRODUCERS = 4;
+    const int NUM_MESSAGES = 10000;
+
+    Mailbox mailbox;
+    MailboxMessage message;
+    TEST_CHECK(!mailbox.pop(message));
+
+    // One thread:
+    for (int i = 0; i < 3; ++i)
+    {
+        mailbox.push(std::make_shared<TestMessage>(0, i));
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        TEST_CHECK(mailbox.pop(message));
+        TEST_CHECK(i == std::static_pointer_cast<TestMessage>(message)
+                ->m_sequence);
+    }
+    TEST_CHECK(!mailbox.pop(message));
+
+    // The popped message can be queued again:
+    TEST_CHECK(1 == message.use_count());
+    mailbox.push(message);
+    TEST_CHECK(2 == message.use_count());
+    TEST_CHECK(mailbox.pop(message));
+    TEST_CHECK(1 == message.use_count());
+
+    // Many producers, the order of each one is preserved:
+    std::vector<Thread> producers;
+    for (int i = 0; i < NUM_PRODUCERS; ++i)
+    {
+        producers.push_back(IThread::create(std::make_shared<TestProducerTask>(
+                mailbox, i, NUM_MESSAGES)));
+    }
+
+    std::vector<int> next(NUM_PRODUCERS, 0);
+    int received = 0;
+    while (received < NUM_PRODUCERS * NUM_MESSAGES)
+    {
+        if (!mailbox.pop(message))
+        {
+            sched_yield();
+            continue;
+        }
+
+        auto test_message = std::static_pointer_cast<TestMessage>(message);
+        TEST_CHECK(next[test_message->m_producer] == test_message->m_sequence);
+        ++next[test_message->m_producer];
+        ++received;
+    }
+    TEST_CHECK(!mailbox.pop(message));
+
+    for (auto &producer: producers)
+    {
+        producer->join();
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void
+test_actors()
+{
+    const int NUM_THREADS = 4;
+    const int NUM_ACTORS = 10000;
+    const int NUM_MESSAGES = 10;
+
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(NUM_THREADS));
+    std::atomic<int> total(0);
+
+    std::vector<std::unique_ptr<TestCounterActor> > actors;
+    for (int i = 0; i < NUM_ACTORS; ++i)
+    {
+        actors.emplace_back(new TestCounterActor(*pool, total));
+    }
+
+    for (int j = 0; j < NUM_MESSAGES; ++j)
+    {
+        for (auto &actor: actors)
+        {
+            actor->send(std::make_shared<TestMessage>(0, j));
+        }
+    }
+
+    while (total.load() < NUM_ACTORS * NUM_MESSAGES)
+    {
+        sched_yield();
+    }
+
+    pool->join();
+
+    for (auto &actor: actors)
+    {
+        TEST_CHECK(0 == actor->pending());
+        TEST_CHECK(NUM_MESSAGES == actor->m_received);
+        TEST_CHECK(actor->m_exclusive);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+struct TestSession
+{
+    std::vector<int> m_sequence;
+    std::atomic<int> m_active;
+    bool m_exclusive;
+
+    TestSession()
+            :
+            m_active(0),
+            m_exclusive(true)
+    {
+    }
+};
+
+// -----------------------------------------------------------------------------
+
+class TestSessionTask
+        :
+                public ITask
+{
+
+    TestSession &m_session;
+    int m_value;
+    std::atomic<int> &m_total;
+
+public:
+
+    TestSessionTask(TestSession &session, int value, std::atomic<int> &total)
+            :
+            m_session(session),
+            m_value(value),
+            m_total(total)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        m_session.m_exclusive = m_session.m_exclusive
+                                && (0 == m_session.m_active.fetch_add(1));
+        m_session.m_sequence.push_back(m_value);
+        m_session.m_active.fetch_sub(1);
+
+        m_total.fetch_add(1);
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+void
+test_strands()
+{
+    const int NUM_THREADS = 4;
+    const int NUM_KEYS = 1000;
+    const int NUM_TASKS = 20;
+
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(NUM_THREADS));
+    StrandMapT<int> strands(*pool);
+    std::atomic<int> total(0);
+
+    // Tasks of the same session run in order and one at a time:
+    std::vector<TestSession> sessions(NUM_KEYS);
+    for (int j = 0; j < NUM_TASKS; ++j)
+    {
+        for (int i = 0; i < NUM_KEYS; ++i)
+        {
+            strands.post(i, std::make_shared<TestSessionTask>(sessions[i], j,
+                                                              total));
+        }
+    }
+
+    while (total.load() < NUM_KEYS * NUM_TASKS)
+    {
+        sched_yield();
+    }
+
+    for (auto &session: sessions)
+    {
+        TEST_CHECK(session.m_exclusive);
+        TEST_CHECK(NUM_TASKS == session.m_sequence.size());
+        for (int j = 0; j < NUM_TASKS; ++j)
+        {
+            TEST_CHECK(j == session.m_sequence[j]);
+        }
+    }
+
+    // The idle strands are dropped while new keys come:
+    std::vector<TestSession> new_sessions(NUM_KEYS * 10);
+    for (std::size_t i = 0; i < new_sessions.size(); ++i)
+    {
+        strands.post(NUM_KEYS + int(i),
+                     std::make_shared<TestSessionTask>(new_sessions[i], 0,
+                                                       total));
+    }
+    TEST_CHECK(strands.size() < NUM_KEYS + new_sessions.size());
+
+    while (total.load() < NUM_KEYS * (NUM_TASKS + 10))
+    {
+        sched_yield();
+    }
+
+    pool->join();
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+ * Keeps one worker busy until the gate opens.
+ */
+class TestGateTask
+        :
+                public ITask
+{
+
+    const std::atomic<bool> &m_gate;
+
+public:
+
+    explicit TestGateTask(const std::atomic<bool> &gate)
+            : m_gate(gate)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        while (!m_gate.load())
+        {
+            sched_yield();
+        }
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+class TestCancelTask
+        :
+                public ITask
+{
+
+public:
+
+    bool m_executed;
+    bool m_cancel_called;
+
+    TestCancelTask()
+            :
+            m_executed(false),
+            m_cancel_called(false)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        m_executed = true;
+    }
+
+    virtual void
+    cancel()
+    {
+        m_cancel_called = true;
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+// Waits for the only worker of the pool to take the task queued first:
+void
+wait_queue_empty(const IThreadPool &pool)
+{
+    ThreadPoolStats stats;
+    for (pool.stats(stats); stats.queue_size > 0; pool.stats(stats))
+    {
+        sched_yield();
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void
+test_shutdown()
+{
+    const int NUM_MESSAGES = 5;
+
+    ThreadPoolOptions options(1, 2);
+    options.rejection_policy = ThreadPoolOptions::REJECT_DROP_OLDEST;
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(options));
+
+    std::atomic<bool> gate(false);
+    TEST_CHECK(pool->push(std::make_shared<TestGateTask>(gate)) > 0);
+    wait_queue_empty(*pool);
+
+    std::atomic<int> total(0);
+    TestCounterActor actor(*pool, total);
+    for (int i = 0; i < NUM_MESSAGES; ++i)
+    {
+        actor.send(std::make_shared<TestMessage>(0, i));
+    }
+
+    Strand strand(*pool);
+    auto task = std::make_shared<TestCancelTask>();
+    strand.post(task);
+
+    // The activations fill the queue and are not dropped:
+    auto dropped = std::make_shared<TestCancelTask>();
+    TEST_CHECK(0 == pool->push(dropped));
+    TEST_CHECK(dropped->m_cancel_called);
+
+    // Cancelled along with the pool, they discard their messages:
+    pool->cancel();
+    gate = true;
+    pool->join();
+
+    TEST_CHECK(0 == actor.pending());
+    TEST_CHECK(0 == actor.m_received);
+    TEST_CHECK(0 == strand.pending());
+    TEST_CHECK(task->m_cancel_called);
+    TEST_CHECK(!task->m_executed);
+
+    // And the ones sent afterwards:
+    actor.send(std::make_shared<TestMessage>(0, NUM_MESSAGES));
+    TEST_CHECK(0 == actor.pending());
+}
+
+} // anonymous namespace
+
+// -----------------------------------------------------------------------------
+
+void
+test_Actor()
+{
+    test_mailbox();
+    test_actors();
+    test_strands();
+    test_shutdown();
+}
+
+// -----------------------------------------------------------------------------
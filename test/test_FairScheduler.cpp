@@ -0,0 +1,404 @@
+/**
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "FairScheduler.h"
+#include "test_Utils.h"
+
+#include "Clock.h"
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <sched.h>
+
+// -----------------------------------------------------------------------------
+
+namespace {
+
+/**
+ * Keeps one worker busy until the gate opens.
+ */
+class TestGateTask
+        :
+                public ITask
+{
+
+    const std::atomic<bool> &m_gate;
+
+public:
+
+    explicit TestGateTask(const std::atomic<bool> &gate)
+            : m_gate(gate)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        while (!m_gate.load())
+        {
+            sched_yield();
+        }
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+/**
+ * Spins for a while, tracking the order of execution and how many tasks of
+ * the same group run at the same time.
+ */
+class TestGroupTask
+        :
+                public ITask
+{
+
+    int m_group;
+    std::uint64_t m_duration_ns;
+    std::vector<int> *m_order;
+    std::atomic<int> &m_running;
+    std::atomic<int> &m_max_running;
+
+public:
+
+    TestGroupTask(int group,
+                  std::uint64_t duration_ns,
+                  std::vector<int> *order,
+                  std::atomic<int> &running,
+                  std::atomic<int> &max_running)
+            :
+            m_group(group),
+            m_duration_ns(duration_ns),
+            m_order(order),
+            m_running(running),
+            m_max_running(max_running)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        int running = ++m_running;
+        int max_running = m_max_running.load();
+        while (running > max_running
+                && !m_max_running.compare_exchange_weak(max_running, running))
+        {
+        }
+
+        std::uint64_t start = clock_now_ns();
+        while (clock_now_ns() - start < m_duration_ns)
+        {
+            sched_yield();
+        }
+
+        // Only recorded by the groups running one task at a time:
+        if (nullptr != m_order)
+        {
+            m_order->push_back(m_group);
+        }
+        --m_running;
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+class TestFailingTask
+        :
+                public ITask
+{
+
+public:
+
+    virtual void
+    execute()
+    {
+        throw std::runtime_error("failing task");
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+class TestCancelTask
+        :
+                public ITask
+{
+
+public:
+
+    bool m_executed;
+    bool m_cancel_called;
+
+    TestCancelTask()
+            :
+            m_executed(false),
+            m_cancel_called(false)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        m_executed = true;
+    }
+
+    virtual void
+    cancel()
+    {
+        m_cancel_called = true;
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+// Waits for the only worker of the pool to take the task queued first:
+void
+wait_queue_empty(const IThreadPool &pool)
+{
+    ThreadPoolStats stats;
+    for (pool.stats(stats); stats.queue_size > 0; pool.stats(stats))
+    {
+        sched_yield();
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void
+wait_executed(const FairScheduler &scheduler,
+              FairScheduler::Group group,
+              std::uint64_t count)
+{
+    FairSchedulerGroupStats stats;
+    for (;;)
+    {
+        scheduler.stats(group, stats);
+        if (stats.executed >= count)
+        {
+            break;
+        }
+
+        sched_yield();
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+// Runs a burst of heavy tasks then of light ones, returns the number of
+// heavy ones among the first num_tasks executed:
+std::size_t
+run_weights(std::size_t num_tasks)
+{
+    const std::uint64_t DURATION_NS = 20000;
+    const std::uint64_t QUANTUM_NS = 10000;
+
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(1));
+    FairScheduler scheduler(*pool, 1, QUANTUM_NS);
+    FairScheduler::Group heavy = scheduler.add_group(3);
+    FairScheduler::Group light = scheduler.add_group(1);
+
+    // Queues all the tasks before the first one runs:
+    std::atomic<bool> gate(false);
+    TEST_CHECK(pool->post(std::make_shared<TestGateTask>(gate)) > 0);
+
+    std::vector<int> order;
+    std::atomic<int> running(0);
+    std::atomic<int> max_running(0);
+    for (std::size_t i = 0; i < num_tasks; ++i)
+    {
+        scheduler.post(heavy, std::make_shared<TestGroupTask>(
+                int(heavy), DURATION_NS, &order, running, max_running));
+    }
+    for (std::size_t i = 0; i < num_tasks; ++i)
+    {
+        scheduler.post(light, std::make_shared<TestGroupTask>(
+                int(light), DURATION_NS, &order, running, max_running));
+    }
+    TEST_CHECK(2 * num_tasks == scheduler.pending());
+
+    gate = true;
+    wait_executed(scheduler, heavy, num_tasks);
+    wait_executed(scheduler, light, num_tasks);
+    TEST_CHECK(0 == scheduler.pending());
+    TEST_CHECK(1 == max_running.load());
+
+    // The light group is not starved by the burst posted before it, the
+    // heavy one gets about three quarters of the time meanwhile:
+    TEST_CHECK(2 * num_tasks == order.size());
+    std::size_t heavy_first = 0;
+    for (std::size_t i = 0; i < num_tasks; ++i)
+    {
+        if (int(heavy) == order[i])
+        {
+            ++heavy_first;
+        }
+    }
+
+    FairSchedulerGroupStats stats;
+    scheduler.stats(heavy, stats);
+    TEST_CHECK(0 == stats.pending);
+    TEST_CHECK(0 == stats.running);
+    TEST_CHECK(stats.busy_ns >= num_tasks * DURATION_NS);
+
+    pool->join();
+    return heavy_first;
+}
+
+// -----------------------------------------------------------------------------
+
+void
+test_weights()
+{
+    const std::size_t NUM_TASKS = 40;
+    const int NUM_ATTEMPTS = 5;
+
+    // The groups are charged the time measured, a task preempted by the
+    // system costs its group many quanta: the share is checked over a few
+    // attempts, one of them at least not being disturbed.
+    std::size_t heavy_first = 0;
+    for (int attempt = 0; attempt < NUM_ATTEMPTS; ++attempt)
+    {
+        heavy_first = run_weights(NUM_TASKS);
+        if (heavy_first > NUM_TASKS / 2 && heavy_first < NUM_TASKS)
+        {
+            break;
+        }
+    }
+    TEST_CHECK(heavy_first > NUM_TASKS / 2);
+    TEST_CHECK(heavy_first < NUM_TASKS);
+}
+
+// -----------------------------------------------------------------------------
+
+void
+test_caps()
+{
+    const int NUM_THREADS = 4;
+    const int NUM_TASKS = 20;
+
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(NUM_THREADS));
+    FairScheduler scheduler(*pool, NUM_THREADS);
+    FairScheduler::Group capped = scheduler.add_group(1, 1);
+    FairScheduler::Group other = scheduler.add_group(1);
+
+    std::vector<int> capped_order;
+    std::atomic<int> capped_running(0);
+    std::atomic<int> capped_max_running(0);
+    std::atomic<int> other_running(0);
+    std::atomic<int> other_max_running(0);
+    for (int i = 0; i < NUM_TASKS; ++i)
+    {
+        scheduler.post(capped, std::make_shared<TestGroupTask>(
+                int(capped), 10000, &capped_order, capped_running,
+                capped_max_running));
+        scheduler.post(other, std::make_shared<TestGroupTask>(
+                int(other), 0, nullptr, other_running,
+                other_max_running));
+    }
+
+    // A failing task is reported by the task itself:
+    auto failing = std::make_shared<TestFailingTask>();
+    scheduler.post(other, failing);
+
+    wait_executed(scheduler, capped, NUM_TASKS);
+    wait_executed(scheduler, other, NUM_TASKS + 1);
+
+    TEST_CHECK(1 == capped_max_running.load());
+    TEST_CHECK(NUM_TASKS == capped_order.size());
+    TEST_CHECK(failing->has_failed());
+
+    pool->join();
+}
+
+// -----------------------------------------------------------------------------
+
+void
+test_shutdown()
+{
+    const int NUM_TASKS = 5;
+
+    ThreadPoolOptions options(1, 1);
+    options.rejection_policy = ThreadPoolOptions::REJECT_DROP_OLDEST;
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(options));
+
+    std::atomic<bool> gate(false);
+    TEST_CHECK(pool->push(std::make_shared<TestGateTask>(gate)) > 0);
+    wait_queue_empty(*pool);
+
+    FairScheduler scheduler(*pool, 1);
+    FairScheduler::Group group = scheduler.add_group(1);
+    std::vector<std::shared_ptr<TestCancelTask> > tasks;
+    for (int i = 0; i < NUM_TASKS; ++i)
+    {
+        tasks.push_back(std::make_shared<TestCancelTask>());
+        scheduler.post(group, tasks.back());
+    }
+
+    // The task of the scheduler fills the queue and is not dropped:
+    auto dropped = std::make_shared<TestCancelTask>();
+    TEST_CHECK(0 == pool->push(dropped));
+    TEST_CHECK(dropped->m_cancel_called);
+
+    // Cancelled along with the pool, it cancels the queued tasks:
+    pool->cancel();
+    gate = true;
+    pool->join();
+
+    TEST_CHECK(0 == scheduler.pending());
+    for (auto &task: tasks)
+    {
+        TEST_CHECK(task->m_cancel_called);
+        TEST_CHECK(!task->m_executed);
+    }
+
+    // And the ones posted afterwards:
+    auto late = std::make_shared<TestCancelTask>();
+    scheduler.post(group, late);
+    TEST_CHECK(late->m_cancel_called);
+    TEST_CHECK(0 == scheduler.pending());
+}
+
+} // anonymous namespace
+
+// -----------------------------------------------------------------------------
+
+void
+test_FairScheduler()
+{
+    test_weights();
+    test_caps();
+    test_shutdown();
+}
+
+// -----------------------------------------------------------------------------
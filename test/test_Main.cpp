@@ -29,10 +29,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <Trace.h>
 
+void test_Actor();
+void test_FairScheduler();
+void test_Mutex();
 void test_PI();
 void test_Thread();
 void test_MessageQueue();
+void test_SpscQueue();
 void test_ThreadPool();
+void test_Trace();
 
 int main(int argc, char *argv[])
 {
@@ -42,8 +47,13 @@ int main(int argc, char *argv[])
     trace_set(true);
 
     test_Thread();
+    test_Mutex();
+    test_Trace();
     test_MessageQueue();
+    test_SpscQueue();
     test_ThreadPool();
+    test_Actor();
+    test_FairScheduler();
     test_PI();
 
     return 0;
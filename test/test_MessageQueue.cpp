@@ -28,15 +28,23 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "MessageQueue.h"
+#include "test_Utils.h"
+
+#include "Selector.h"
 #include "Thread.h"
 #include "Trace.h"
 
 #include <deque>
 #include <string>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <sstream>
 #include <vector>
 
+#include <poll.h>
+#include <sched.h>
+
 // ------------------------------------------------------------------------....
 
 namespace
@@ -70,34 +78,33 @@ public:
     void
     execute()
     {
-        trace("Running");
+        TRACE_DEBUG(TRACE_CATEGORY_TEST, "Running");
 
         std::string message;
         while (m_in_queue.pop(message, true))
         {
-            trace(message);
+            TRACE_DEBUG(TRACE_CATEGORY_TEST, message);
 
             std::stringstream response;
             response << "Response to '" << message << " from '" << m_id << "'";
 
             while (0 == m_out_queue.push(response.str()))
             {
-                trace("Waiting for a free slot into the output queue");
+                TRACE_DEBUG(TRACE_CATEGORY_TEST,
+                            "Waiting for a free slot into the output queue");
                 sched_yield();
             }
         }
 
-        trace("Done.");
+        TRACE_DEBUG(TRACE_CATEGORY_TEST, "Done.");
     }
 
 };
 
-} // anonymous namespace
-
 // ----------------------------------------------------------------------------
 
 void
-test_MessageQueue()
+test_threads()
 {
     const int NUM_THREADS = 100;
     const int NUM_MESSAGES = 100000;
@@ -153,11 +160,10 @@ test_MessageQueue()
                 std::size_t num = queue_out.pop(message, num_messages_in > 0);
                 if (num > 0)
                 {
-                    std::stringstream str;
-                    str << 0 << ": " << message
-                            << " #" << queue_in.size()
-                            << ":" << queue_out.size() << std::endl;
-                    trace(str.str());
+                    TRACE_DEBUG(TRACE_CATEGORY_TEST,
+                                0 << ": " << message
+                                << " #" << queue_in.size()
+                                << ":" << queue_out.size());
                     --num_messages_out;
                 }
                 else
@@ -178,3 +184,384 @@ test_MessageQueue()
 }
 
 // ----------------------------------------------------------------------------
+
+void
+test_stats()
+{
+    const int QUEUE_CAPACITY = 3;
+
+    MessageQueueT<int> queue(QUEUE_CAPACITY);
+    for (int i = 0; i < QUEUE_CAPACITY; ++i)
+    {
+        TEST_CHECK(queue.push(i) == std::size_t(i + 1));
+    }
+    TEST_CHECK(0 == queue.push(QUEUE_CAPACITY));
+
+    int message = -1;
+    TEST_CHECK(QUEUE_CAPACITY == queue.pop(message, false));
+    TEST_CHECK(0 == message);
+
+    MessageQueueStats stats;
+    queue.stats(stats);
+    TEST_CHECK(QUEUE_CAPACITY - 1 == queue.size());
+    TEST_CHECK(QUEUE_CAPACITY - 1 == stats.size);
+    TEST_CHECK(QUEUE_CAPACITY == stats.high_watermark);
+    TEST_CHECK(QUEUE_CAPACITY == stats.pushed);
+    TEST_CHECK(1 == stats.popped);
+    TEST_CHECK(1 == stats.rejected);
+}
+
+// ----------------------------------------------------------------------------
+
+class TestDrainTask
+    : public ITask
+{
+
+    MessageQueueT<int> &m_queue;
+
+public:
+
+    int m_received;
+
+    explicit TestDrainTask(MessageQueueT<int> &queue)
+            :
+            m_queue(queue),
+            m_received(0)
+    {
+    }
+
+    void
+    execute()
+    {
+        int message;
+        while (m_queue.pop(message, true))
+        {
+            ++m_received;
+        }
+    }
+
+};
+
+// ----------------------------------------------------------------------------
+
+void
+test_close()
+{
+    const int NUM_MESSAGES = 1000;
+
+    MessageQueueT<int> queue;
+    auto consumer = std::make_shared<TestDrainTask>(queue);
+    Thread consumer_thread(IThread::create(consumer));
+
+    for (int i = 0; i < NUM_MESSAGES; ++i)
+    {
+        TEST_CHECK(queue.push(i) > 0);
+    }
+
+    queue.close();
+    TEST_CHECK(queue.is_closed());
+    TEST_CHECK(!queue.is_cancelled());
+    TEST_CHECK(0 == queue.push(NUM_MESSAGES));
+
+    // The consumer gets every message before the end of the stream:
+    consumer_thread->join();
+    TEST_CHECK(NUM_MESSAGES == consumer->m_received);
+
+    int message;
+    TEST_CHECK(0 == queue.pop(message, true));
+}
+
+// ----------------------------------------------------------------------------
+
+class TestProducerTask
+    : public ITask
+{
+
+    MessageQueueT<int> &m_queue;
+    int m_count;
+
+public:
+
+    TestProducerTask(MessageQueueT<int> &queue, int count)
+            :
+            m_queue(queue),
+            m_count(count)
+    {
+    }
+
+    void
+    execute()
+    {
+        for (int i = 0; i < m_count; ++i)
+        {
+            m_queue.push(i);
+            if (i % 64 == 0)
+            {
+                sched_yield();
+            }
+        }
+
+        m_queue.close();
+    }
+
+};
+
+// ----------------------------------------------------------------------------
+
+void
+test_selector()
+{
+    const int NUM_QUEUES = 3;
+    const int NUM_MESSAGES = 10000;
+
+    std::vector<std::unique_ptr<MessageQueueT<int> > > queues;
+    Selector selector;
+    for (int i = 0; i < NUM_QUEUES; ++i)
+    {
+        queues.emplace_back(new MessageQueueT<int>());
+        TEST_CHECK(std::size_t(i) == selector.add(queues.back()->interface()));
+    }
+
+    TEST_CHECK(Selector::NONE == selector.select(false));
+    queues[1]->push(-1);
+    TEST_CHECK(1 == selector.select(false));
+    TEST_CHECK(1 == selector.select(true));
+
+    int message = 0;
+    queues[1]->pop(message, false);
+    TEST_CHECK(-1 == message);
+
+    std::vector<Thread> producers;
+    for (auto &queue: queues)
+    {
+        producers.push_back(IThread::create(
+                std::make_shared<TestProducerTask>(*queue, NUM_MESSAGES)));
+    }
+
+    // One thread serves all the queues until every one is closed and empty:
+    std::vector<int> next(NUM_QUEUES, 0);
+    Message abstract_message;
+    std::size_t index = Selector::NONE;
+    while (selector.pop(abstract_message, index, true) > 0)
+    {
+        TEST_CHECK(index < NUM_QUEUES);
+        TEST_CHECK(next[index] == MessageQueueT<int>::payload(abstract_message));
+        ++next[index];
+    }
+
+    for (int i = 0; i < NUM_QUEUES; ++i)
+    {
+        TEST_CHECK(NUM_MESSAGES == next[i]);
+    }
+
+    for (auto &producer: producers)
+    {
+        producer->join();
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+bool
+is_readable(int fd)
+{
+    struct pollfd poll_fd;
+    poll_fd.fd = fd;
+    poll_fd.events = POLLIN;
+    poll_fd.revents = 0;
+
+    return 1 == ::poll(&poll_fd, 1, 0) && (poll_fd.revents & POLLIN) != 0;
+}
+
+// ----------------------------------------------------------------------------
+
+void
+test_readiness()
+{
+    MessageQueueT<int> queue;
+    IMessageQueue &abstract_queue = queue.interface();
+
+    int fd = abstract_queue.readiness_fd();
+    TEST_CHECK(fd >= 0);
+    TEST_CHECK(fd == abstract_queue.readiness_fd());
+    TEST_CHECK(!is_readable(fd));
+
+    // Signalled by the first push only:
+    queue.push(1);
+    queue.push(2);
+    TEST_CHECK(is_readable(fd));
+
+    abstract_queue.clear_readiness();
+    TEST_CHECK(!is_readable(fd));
+
+    int message;
+    while (queue.pop(message, false) > 0)
+    {
+    }
+
+    queue.push(3);
+    TEST_CHECK(is_readable(fd));
+    abstract_queue.clear_readiness();
+    queue.pop(message, false);
+    TEST_CHECK(3 == message);
+
+    // The end of the stream is signalled too:
+    queue.close();
+    TEST_CHECK(is_readable(fd));
+
+    // Created on a ready queue:
+    MessageQueueT<int> ready_queue;
+    ready_queue.push(1);
+    TEST_CHECK(is_readable(ready_queue.interface().readiness_fd()));
+}
+
+// ----------------------------------------------------------------------------
+
+void
+test_pop_all()
+{
+    const int NUM_MESSAGES = 10;
+    const std::size_t MAX_COUNT = 3;
+
+    MessageQueueT<int> queue;
+    IMessageQueue &abstract_queue = queue.interface();
+
+    std::deque<Message> messages;
+    TEST_CHECK(0 == abstract_queue.pop_all(messages, MAX_COUNT, false));
+
+    for (int i = 0; i < NUM_MESSAGES; ++i)
+    {
+        queue.push(i);
+    }
+
+    TEST_CHECK(MAX_COUNT == abstract_queue.pop_all(messages, MAX_COUNT, true));
+    TEST_CHECK(NUM_MESSAGES - MAX_COUNT == queue.size());
+
+    TEST_CHECK(NUM_MESSAGES - MAX_COUNT
+               == abstract_queue.pop_all(messages, NUM_MESSAGES, false));
+    TEST_CHECK(0 == queue.size());
+
+    TEST_CHECK(NUM_MESSAGES == messages.size());
+    for (int i = 0; i < NUM_MESSAGES; ++i)
+    {
+        TEST_CHECK(i == MessageQueueT<int>::payload(messages[i]));
+    }
+
+    MessageQueueStats stats;
+    queue.stats(stats);
+    TEST_CHECK(NUM_MESSAGES == stats.popped);
+
+    // Released by the end of the stream:
+    messages.clear();
+    queue.close();
+    TEST_CHECK(0 == abstract_queue.pop_all(messages, MAX_COUNT, true));
+}
+
+// ----------------------------------------------------------------------------
+
+void
+test_ordered()
+{
+    MessageQueueT<int> queue;
+    IMessageQueue &abstract_queue = queue.interface();
+
+    // The ordered messages come first, lowest key first and FIFO between
+    // equal keys:
+    TEST_CHECK(1 == queue.push(100));
+    TEST_CHECK(2 == queue.push_ordered(5, 50));
+    TEST_CHECK(3 == queue.push_ordered(3, 30));
+    TEST_CHECK(4 == queue.push_ordered(4, 30));
+    TEST_CHECK(5 == queue.push(101));
+    TEST_CHECK(6 == queue.push_ordered(9, 90));
+
+    int message = 0;
+    TEST_CHECK(6 == queue.pop(message, false));
+    TEST_CHECK(3 == message);
+    TEST_CHECK(5 == queue.pop(message, false));
+    TEST_CHECK(4 == message);
+
+    std::deque<Message> messages;
+    TEST_CHECK(4 == abstract_queue.pop_all(messages, 10, false));
+    TEST_CHECK(4 == messages.size());
+    TEST_CHECK(5 == MessageQueueT<int>::payload(messages[0]));
+    TEST_CHECK(9 == MessageQueueT<int>::payload(messages[1]));
+    TEST_CHECK(100 == MessageQueueT<int>::payload(messages[2]));
+    TEST_CHECK(101 == MessageQueueT<int>::payload(messages[3]));
+    TEST_CHECK(0 == queue.size());
+
+    // The eviction keeps the most urgent messages, the ordered ones:
+    TEST_CHECK(1 == queue.push_ordered(1, 10));
+    TEST_CHECK(2 == queue.push(200));
+    TEST_CHECK(3 == queue.push_ordered(2, 20));
+    TEST_CHECK(4 == queue.push(201));
+    TEST_CHECK(5 == queue.push_ordered(3, 20));
+
+    Message evicted;
+    TEST_CHECK(5 == abstract_queue.evict(evicted));
+    TEST_CHECK(200 == MessageQueueT<int>::payload(evicted));
+    TEST_CHECK(4 == abstract_queue.evict(evicted));
+    TEST_CHECK(201 == MessageQueueT<int>::payload(evicted));
+    TEST_CHECK(3 == abstract_queue.evict(evicted));
+    TEST_CHECK(3 == MessageQueueT<int>::payload(evicted));
+
+    TEST_CHECK(2 == queue.pop(message, false));
+    TEST_CHECK(1 == message);
+    TEST_CHECK(1 == abstract_queue.evict(evicted));
+    TEST_CHECK(2 == MessageQueueT<int>::payload(evicted));
+    TEST_CHECK(0 == abstract_queue.evict(evicted));
+}
+
+// ----------------------------------------------------------------------------
+
+void
+test_wait_strategy()
+{
+    const int NUM_MESSAGES = 1000;
+
+    // Polls through all the phases before parking:
+    MessageQueueT<int> queue(std::numeric_limits<std::size_t>::max(),
+                             WaitStrategy(100, 100, 10));
+    auto consumer = std::make_shared<TestDrainTask>(queue);
+    Thread consumer_thread(IThread::create(consumer));
+
+    for (int i = 0; i < NUM_MESSAGES; ++i)
+    {
+        TEST_CHECK(queue.push(i) > 0);
+        if (0 == i % 100)
+        {
+            sched_yield();
+        }
+    }
+
+    queue.close();
+    consumer_thread->join();
+    TEST_CHECK(NUM_MESSAGES == consumer->m_received);
+
+    // A polling consumer is released by the cancellation too:
+    MessageQueueT<int> cancelled_queue(std::numeric_limits<std::size_t>::max(),
+                                       WaitStrategy(0, 0, 1000000));
+    auto cancelled_consumer = std::make_shared<TestDrainTask>(cancelled_queue);
+    Thread cancelled_thread(IThread::create(cancelled_consumer));
+    cancelled_queue.cancel();
+    cancelled_thread->join();
+    TEST_CHECK(0 == cancelled_consumer->m_received);
+}
+
+} // anonymous namespace
+
+// ----------------------------------------------------------------------------
+
+void
+test_MessageQueue()
+{
+    test_threads();
+    test_stats();
+    test_close();
+    test_selector();
+    test_readiness();
+    test_pop_all();
+    test_ordered();
+    test_wait_strategy();
+}
+
+// ----------------------------------------------------------------------------
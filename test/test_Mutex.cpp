@@ -0,0 +1,172 @@
+/**
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Mutex.h"
+#include "test_Utils.h"
+
+#include "Histogram.h"
+#include "MutexProfile.h"
+#include "Thread.h"
+#include "Trace.h"
+
+#include <sstream>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+namespace {
+
+void
+test_histogram()
+{
+    for (std::uint64_t value = 1; value != 0; value <<= 1)
+    {
+        std::size_t index = Histogram::bucket_index(value);
+        TEST_CHECK(Histogram::bucket_lower_bound(index) <= value);
+        TEST_CHECK(Histogram::bucket_upper_bound(index) >= value);
+        TEST_CHECK(index < Histogram::BUCKET_COUNT);
+    }
+
+    Histogram histogram;
+    for (std::uint64_t value = 1; value <= 1000; ++value)
+    {
+        histogram.record(value);
+    }
+
+    HistogramSnapshot snapshot;
+    histogram.snapshot(snapshot);
+    TEST_CHECK(snapshot.count == 1000);
+    TEST_CHECK(snapshot.max == 1000);
+    TEST_CHECK(snapshot.percentile(100.0) == 1000);
+
+    // Relative error is bounded by the sub-buckets resolution:
+    std::uint64_t median = snapshot.percentile(50.0);
+    TEST_CHECK(median >= 500 && median <= 500 + 500 / 16);
+}
+
+// -----------------------------------------------------------------------------
+
+class TestProfileTask
+        :
+                public ITask
+{
+
+    Mutex &m_mutex;
+    int &m_counter;
+
+public:
+
+    TestProfileTask(Mutex &mutex, int &counter)
+            :
+            m_mutex(mutex),
+            m_counter(counter)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        for (int i = 0; i < 1000; ++i)
+        {
+            Locker<Mutex> lock(m_mutex);
+            ++m_counter;
+        }
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+void
+test_profile()
+{
+    const int NUM_THREADS = 8;
+
+    Mutex mutex("test_profile");
+    int counter = 0;
+
+    mutex_profile_reset();
+    mutex_profile_set(true);
+    {
+        std::vector<Thread> threads;
+        for (int i = 0; i < NUM_THREADS; ++i)
+        {
+            Task task = std::make_shared<TestProfileTask>(mutex, counter);
+            threads.push_back(IThread::create(task));
+        }
+
+        for (auto &thread: threads)
+        {
+            thread->join();
+        }
+    }
+    mutex_profile_set(false);
+
+    TEST_CHECK(NUM_THREADS * 1000 == counter);
+
+    // Not accounted any more:
+    {
+        Locker<Mutex> lock(mutex);
+        ++counter;
+    }
+
+    std::vector<MutexProfileEntry> entries;
+    mutex_profile_snapshot(entries);
+
+    bool found = false;
+    for (auto &entry: entries)
+    {
+        if (entry.name == "test_profile")
+        {
+            found = true;
+            TEST_CHECK(entry.acquisitions == NUM_THREADS * 1000);
+            TEST_CHECK(entry.contentions <= entry.acquisitions);
+            TEST_CHECK(entry.wait.count == entry.contentions);
+            TEST_CHECK(entry.hold.count == entry.acquisitions);
+        }
+    }
+    TEST_CHECK(found);
+
+    std::stringstream report;
+    mutex_profile_report(report);
+    trace(report);
+}
+
+} // anonymous namespace
+
+// -----------------------------------------------------------------------------
+
+void
+test_Mutex()
+{
+    test_histogram();
+    test_profile();
+}
+
+// -----------------------------------------------------------------------------
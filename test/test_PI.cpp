@@ -29,14 +29,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "test_Utils.h"
 
+#include "Clock.h"
 #include "Thread.h"
 #include "ThreadPool.h"
 #include "Trace.h"
 
 #include <atomic>
-#include <sstream>
 #include <cstdlib>
-#include <ctime>
+#include <deque>
 #include <random>
 
 // -----------------------------------------------------------------------------
@@ -96,7 +96,7 @@ test_PI(int NUM_THREADS)
     auto mainThread = IThread::self();
     std::size_t numPositive = 0;
 
-    std::clock_t begin = std::clock();
+    std::uint64_t begin = clock_now_ns();
     {
         std::unique_ptr <IThreadPool> pool(
                 IThreadPool::create(NUM_THREADS, QUEUE_CAPACITY));
@@ -115,39 +115,42 @@ test_PI(int NUM_THREADS)
             TEST_CHECK(res != 0);
         }
 
-        // Collects their results:
-        for (size_t i = 0; i < NUM_TASKS; ++i)
+        // Collects their results, as many as available at once:
+        std::deque<Task> tasks;
+        for (size_t collected = 0; collected < NUM_TASKS;)
         {
-            std::shared_ptr<TestTask> task;
-            auto res = pool->popT(task, true);
+            auto res = pool->pop_all(tasks, NUM_TASKS, true);
             TEST_CHECK(res != 0);
+            TEST_CHECK(res == tasks.size());
 
-            TEST_CHECK(bool(task));
-            TEST_CHECK(task->isRun());
-            if (task->result())
+            for (auto &abstract_task: tasks)
             {
-                ++numPositive;
+                auto task = std::dynamic_pointer_cast<TestTask>(abstract_task);
+                TEST_CHECK(bool(task));
+                TEST_CHECK(task->isRun());
+                if (task->result())
+                {
+                    ++numPositive;
+                }
             }
+
+            collected += res;
+            tasks.clear();
         }
 
         pool->join();
     }
-    std::clock_t end = clock();
+    std::uint64_t end = clock_now_ns();
 
     {
-        std::stringstream message;
-        message << "[" << NUM_THREADS << "]";
-        trace(message);
+        TRACE_INFO(TRACE_CATEGORY_TEST, "[" << NUM_THREADS << "]");
 
         TEST_CHECK(numPositive < NUM_TASKS);
         double pi = 4.0 * double(numPositive) / double(NUM_TASKS);
-        message << "PI: " << pi;
-        trace(message);
+        TRACE_INFO(TRACE_CATEGORY_TEST, "PI: " << pi);
 
-        double elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
-        message << "Duration: " << elapsed_secs;
-        trace(message);
-        trace(message);
+        double elapsed_secs = double(end - begin) / 1e9;
+        TRACE_INFO(TRACE_CATEGORY_TEST, "Duration: " << elapsed_secs);
     }
 
 }
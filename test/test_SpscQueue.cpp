@@ -0,0 +1,250 @@
+/**
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "SpscQueue.h"
+#include "test_Utils.h"
+
+#include "Thread.h"
+
+#include <memory>
+
+#include <sched.h>
+#include <unistd.h>
+
+// ----------------------------------------------------------------------------
+
+namespace
+{
+
+class TestProducerTask
+    : public ITask
+{
+
+    SpscQueueT<int> &m_queue;
+    int m_count;
+
+public:
+
+    TestProducerTask(SpscQueueT<int> &queue, int count)
+            :
+            m_queue(queue),
+            m_count(count)
+    {
+    }
+
+    void
+    execute()
+    {
+        for (int i = 0; i < m_count; ++i)
+        {
+            while (0 == m_queue.push(i))
+            {
+                sched_yield();
+            }
+        }
+    }
+
+};
+
+// ----------------------------------------------------------------------------
+
+class TestConsumerTask
+    : public ITask
+{
+
+    SpscQueueT<int> &m_queue;
+
+public:
+
+    int m_received;
+    bool m_ordered;
+
+    explicit TestConsumerTask(SpscQueueT<int> &queue)
+            :
+            m_queue(queue),
+            m_received(0),
+            m_ordered(true)
+    {
+    }
+
+    void
+    execute()
+    {
+        int message;
+        while (m_queue.pop(message, true))
+        {
+            m_ordered = m_ordered && (message == m_received);
+            ++m_received;
+        }
+    }
+
+};
+
+// ----------------------------------------------------------------------------
+
+void
+test_capacity()
+{
+    SpscQueueT<int> queue(3);
+    TEST_CHECK(4 == queue.capacity());
+
+    for (int i = 0; i < 4; ++i)
+    {
+        TEST_CHECK(queue.push(i) == std::size_t(i + 1));
+    }
+    TEST_CHECK(0 == queue.push(4));
+    TEST_CHECK(4 == queue.size());
+
+    int message = -1;
+    TEST_CHECK(4 == queue.pop(message, false));
+    TEST_CHECK(0 == message);
+    TEST_CHECK(4 == queue.push(4));
+
+    for (int i = 1; i < 5; ++i)
+    {
+        TEST_CHECK(0 < queue.pop(message, false));
+        TEST_CHECK(i == message);
+    }
+    TEST_CHECK(0 == queue.pop(message, false));
+    TEST_CHECK(0 == queue.size());
+
+    // Popped messages are not retained by the queue:
+    SpscQueueT<std::shared_ptr<int> > pointers(2);
+    std::shared_ptr<int> pointer(new int(1));
+    pointers.push(pointer);
+    TEST_CHECK(2 == pointer.use_count());
+    std::shared_ptr<int> popped;
+    pointers.pop(popped, false);
+    popped.reset();
+    TEST_CHECK(1 == pointer.use_count());
+}
+
+// ----------------------------------------------------------------------------
+
+void
+test_threads()
+{
+    const int NUM_MESSAGES = 100000;
+    const int QUEUE_CAPACITY = 64;
+
+    SpscQueueT<int> queue(QUEUE_CAPACITY);
+
+    auto consumer = std::make_shared<TestConsumerTask>(queue);
+    Thread consumer_thread(IThread::create(consumer));
+    Thread producer_thread(IThread::create(
+            std::make_shared<TestProducerTask>(queue, NUM_MESSAGES)));
+
+    producer_thread->join();
+    while (queue.size() > 0)
+    {
+        sched_yield();
+    }
+
+    queue.cancel();
+    consumer_thread->join();
+
+    TEST_CHECK(queue.is_cancelled());
+    TEST_CHECK(NUM_MESSAGES == consumer->m_received);
+    TEST_CHECK(consumer->m_ordered);
+}
+
+// ----------------------------------------------------------------------------
+
+void
+test_close()
+{
+    const int NUM_MESSAGES = 1000;
+    const int QUEUE_CAPACITY = 2048;
+
+    SpscQueueT<int> queue(QUEUE_CAPACITY);
+    auto consumer = std::make_shared<TestConsumerTask>(queue);
+    Thread consumer_thread(IThread::create(consumer));
+
+    for (int i = 0; i < NUM_MESSAGES; ++i)
+    {
+        TEST_CHECK(queue.push(i) > 0);
+    }
+
+    queue.close();
+    TEST_CHECK(queue.is_closed());
+    TEST_CHECK(0 == queue.push(NUM_MESSAGES));
+
+    consumer_thread->join();
+    TEST_CHECK(NUM_MESSAGES == consumer->m_received);
+    TEST_CHECK(consumer->m_ordered);
+}
+
+// ----------------------------------------------------------------------------
+
+void
+test_cancel()
+{
+    const int QUEUE_CAPACITY = 16;
+
+    // Parked and polling consumers alike are released with no message:
+    const WaitStrategy strategies[] = {
+        WaitStrategy(),
+        WaitStrategy(0, 0, 1000000)
+    };
+
+    for (auto &strategy: strategies)
+    {
+        SpscQueueT<int> queue(QUEUE_CAPACITY, strategy);
+        auto consumer = std::make_shared<TestConsumerTask>(queue);
+        Thread consumer_thread(IThread::create(consumer));
+
+        // Gives the consumer the time to park:
+        ::usleep(10000);
+
+        queue.cancel();
+        TEST_CHECK(queue.is_cancelled());
+
+        consumer_thread->join();
+        TEST_CHECK(0 == consumer->m_received);
+
+        // A blocking pop on the empty queue doesn't wait any more:
+        int message;
+        TEST_CHECK(0 == queue.pop(message, true));
+    }
+}
+
+} // anonymous namespace
+
+// ----------------------------------------------------------------------------
+
+void
+test_SpscQueue()
+{
+    test_capacity();
+    test_threads();
+    test_close();
+    test_cancel();
+}
+
+// ----------------------------------------------------------------------------
@@ -36,8 +36,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "Trace.h"
 
 #include <iostream>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
+#include <sched.h>
+
 // -----------------------------------------------------------------------------
 
 namespace {
@@ -136,6 +140,8 @@ class TestJoinTask
     Mutex &m_mutex;
     Cond &m_cond_wait;
     Cond *m_cond_signal;
+    bool &m_signalled;
+    bool &m_released;
     int &m_instance_counter;
     int &m_execution_counter;
 
@@ -145,6 +151,8 @@ public:
                  Mutex &mutex,
                  Cond &cond_wait,
                  Cond *cond_signal,
+                 bool &signalled,
+                 bool &released,
                  int &instance_counter,
                  int &execution_counter)
             :
@@ -152,6 +160,8 @@ public:
             m_mutex(mutex),
             m_cond_wait(cond_wait),
             m_cond_signal(cond_signal),
+            m_signalled(signalled),
+            m_released(released),
             m_instance_counter(instance_counter),
             m_execution_counter(execution_counter)
     {
@@ -179,12 +189,18 @@ public:
             self->yield();
             self->yield();
             self->yield();
+
+            Locker<Mutex> lock(m_mutex);
+            m_signalled = true;
             m_cond_signal->signal();
         }
 
         {
             Locker<Mutex> lock(m_mutex);
-            m_cond_wait.wait(m_mutex);
+            while (!m_released) // <- while needed because of spurious wake-ups.
+            {
+                m_cond_wait.wait(m_mutex);
+            }
 
             ++m_execution_counter;
         }
@@ -214,6 +230,8 @@ test_join()
 
     Mutex mutex;
     Cond cond_task, cond_init;
+    bool signalled = false;
+    bool released = false;
     int instance_counter = 0;
     int execution_counter = 0;
 
@@ -233,6 +251,8 @@ test_join()
                     mutex,
                     cond_task,
                     cond_signal,
+                    signalled,
+                    released,
                     instance_counter,
                     execution_counter);
             TEST_CHECK(instance_counter >= 1);
@@ -245,7 +265,12 @@ test_join()
 
         {
             Locker<Mutex> locker(mutex);
-            cond_init.wait(mutex);
+            while (!signalled)
+            {
+                cond_init.wait(mutex);
+            }
+
+            released = true;
             cond_task.broadcast();
         }
 
@@ -262,6 +287,99 @@ test_join()
     TEST_CHECK(0 == instance_counter);
 }
 
+// -----------------------------------------------------------------------------
+
+class TestThrowingTask
+        :
+                public ITask
+{
+
+public:
+
+    virtual void
+    execute()
+    {
+        throw std::runtime_error("failure");
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+void
+test_exception()
+{
+    Task task(new TestThrowingTask());
+    Thread thread(IThread::create(task));
+    thread->join();
+
+    TEST_CHECK(!thread->is_running());
+    TEST_CHECK(task->has_failed());
+
+    bool rethrown = false;
+    try
+    {
+        task->rethrow_if_failed();
+    }
+    catch (const std::runtime_error &error)
+    {
+        rethrown = (std::string("failure") == error.what());
+    }
+    TEST_CHECK(rethrown);
+}
+
+// -----------------------------------------------------------------------------
+
+class TestAffinityTask
+        :
+                public ITask
+{
+
+public:
+
+    std::size_t m_target;
+    bool m_bound;
+    bool m_bound_to_none;
+    int m_cpu;
+
+    explicit TestAffinityTask(std::size_t target)
+            :
+            m_target(target),
+            m_bound(false),
+            m_bound_to_none(true),
+            m_cpu(-1)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        Thread self = IThread::self();
+        m_bound_to_none = self->set_affinity(1u << 20);
+        m_bound = self->set_affinity(m_target);
+        m_cpu = ::sched_getcpu();
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+void
+test_affinity()
+{
+    const std::size_t cpu = test_allowed_cpu();
+
+    auto task = std::make_shared<TestAffinityTask>(cpu);
+    Thread thread(IThread::create(task));
+    thread->join();
+
+    TEST_CHECK(!task->m_bound_to_none);
+#ifdef __linux__
+    TEST_CHECK(task->m_bound);
+    TEST_CHECK(int(cpu) == task->m_cpu);
+#endif
+}
+
 } // anonymous namespace
 
 // -----------------------------------------------------------------------------
@@ -271,6 +389,8 @@ test_Thread()
 {
     test_base();
     test_join();
+    test_exception();
+    test_affinity();
 }
 
 // -----------------------------------------------------------------------------
@@ -30,13 +30,23 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "ThreadPool.h"
 #include "test_Utils.h"
 
+#include "CancellationToken.h"
+#include "Clock.h"
+#include "Thread.h"
 #include "Trace.h"
 #include "Mutex.h"
 
+#include <atomic>
+#include <deque>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
+#include <poll.h>
+#include <sched.h>
+
 // -----------------------------------------------------------------------------
 
 namespace {
@@ -116,12 +126,10 @@ public:
 
 };
 
-} // anonymous namespace
-
 // -----------------------------------------------------------------------------
 
 void
-test_ThreadPool()
+test_base()
 {
     const int NUM_THREADS = 16;
     const int NUM_TASKS = 1000000;
@@ -182,3 +190,1203 @@ test_ThreadPool()
 }
 
 // -----------------------------------------------------------------------------
+
+class TestEmptyTask
+        :
+                public ITask
+{
+
+public:
+
+    virtual void
+    execute()
+    {
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+void
+test_timeline()
+{
+    const int NUM_THREADS = 4;
+    const int NUM_TASKS = 1000;
+
+    ThreadPoolOptions options(NUM_THREADS);
+    options.timeline = std::make_shared<TaskTimeline>(NUM_TASKS / 2);
+
+    {
+        std::unique_ptr<IThreadPool> pool(IThreadPool::create(options));
+        for (int i = 0; i < NUM_TASKS; ++i)
+        {
+            TEST_CHECK(pool->push(std::make_shared<TestEmptyTask>()) > 0);
+        }
+
+        for (int i = 0; i < NUM_TASKS; ++i)
+        {
+            Task task;
+            TEST_CHECK(pool->pop(task, true) > 0);
+        }
+
+        pool->join();
+    }
+
+    const TaskTimeline &timeline = *options.timeline;
+    TEST_CHECK(NUM_TASKS / 2 == timeline.size());
+    TEST_CHECK(NUM_TASKS / 2 == timeline.dropped());
+
+    for (std::size_t i = 0; i < timeline.size(); ++i)
+    {
+        const TaskTimeline::Entry &entry = timeline.entry(i);
+        TEST_CHECK(entry.worker < NUM_THREADS);
+        TEST_CHECK(entry.enqueue_ns <= entry.start_ns);
+        TEST_CHECK(entry.start_ns <= entry.finish_ns);
+    }
+
+    std::stringstream json;
+    timeline.write_chrome_trace(json);
+    TEST_CHECK(json.str().find("\"traceEvents\"") != std::string::npos);
+    TEST_CHECK(json.str().find("TestEmptyTask") != std::string::npos);
+}
+
+// -----------------------------------------------------------------------------
+
+void
+test_stats()
+{
+    const int NUM_THREADS = 2;
+    const int NUM_TASKS = 100;
+
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(NUM_THREADS));
+    for (int i = 0; i < NUM_TASKS; ++i)
+    {
+        TEST_CHECK(pool->push(std::make_shared<TestEmptyTask>()) > 0);
+    }
+
+    for (int i = 0; i < NUM_TASKS; ++i)
+    {
+        Task task;
+        TEST_CHECK(pool->pop(task, true) > 0);
+    }
+
+    ThreadPoolStats stats;
+    pool->stats(stats);
+
+    TEST_CHECK(NUM_TASKS == stats.submitted);
+    TEST_CHECK(NUM_TASKS == stats.completed);
+    TEST_CHECK(0 == stats.rejected);
+    TEST_CHECK(0 == stats.queue_size);
+    TEST_CHECK(stats.queue_high_watermark >= 1);
+    TEST_CHECK(NUM_TASKS == stats.queue_wait.count);
+    TEST_CHECK(NUM_TASKS == stats.execution.count);
+    TEST_CHECK(NUM_THREADS == stats.workers.size());
+
+    std::uint64_t executed = 0;
+    for (auto &worker: stats.workers)
+    {
+        executed += worker.executed;
+        TEST_CHECK(worker.idle_ns > 0);
+    }
+    TEST_CHECK(NUM_TASKS == executed);
+
+    pool->join();
+}
+
+// -----------------------------------------------------------------------------
+
+void
+test_post()
+{
+    const int NUM_TASKS = 100;
+
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(1));
+
+    // Posted tasks are executed but not collected:
+    for (int i = 0; i < NUM_TASKS; ++i)
+    {
+        TEST_CHECK(pool->post(std::make_shared<TestEmptyTask>()) > 0);
+    }
+    TEST_CHECK(pool->push(std::make_shared<TestEmptyTask>()) > 0);
+
+    Task task;
+    TEST_CHECK(1 == pool->pop(task, true));
+    TEST_CHECK(0 == pool->pop(task, false));
+
+    ThreadPoolStats stats;
+    pool->stats(stats);
+    TEST_CHECK(NUM_TASKS + 1 == stats.completed);
+
+    pool->join();
+}
+
+// -----------------------------------------------------------------------------
+
+class TestFlagTask
+        :
+                public ITask
+{
+
+public:
+
+    bool m_executed;
+
+    TestFlagTask()
+            : m_executed(false)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        sched_yield();
+        m_executed = true;
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+void
+test_shutdown()
+{
+    const int NUM_THREADS = 2;
+    const int NUM_TASKS = 1000;
+
+    // Drain: every queued task is executed and can be popped afterwards:
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(NUM_THREADS));
+    for (int i = 0; i < NUM_TASKS; ++i)
+    {
+        TEST_CHECK(pool->push(std::make_shared<TestFlagTask>()) > 0);
+    }
+
+    pool->shutdown(IThreadPool::SHUTDOWN_DRAIN);
+    TEST_CHECK(pool->is_closed());
+    TEST_CHECK(0 == pool->push(std::make_shared<TestFlagTask>()));
+
+    std::shared_ptr<TestFlagTask> task;
+    for (int i = 0; i < NUM_TASKS; ++i)
+    {
+        TEST_CHECK(pool->popT(task, false) > 0);
+        TEST_CHECK(task->m_executed);
+    }
+    TEST_CHECK(0 == pool->popT(task, false));
+
+    pool->join();
+
+    // Abort:
+    pool.reset(IThreadPool::create(1));
+    for (int i = 0; i < NUM_TASKS; ++i)
+    {
+        TEST_CHECK(pool->push(std::make_shared<TestFlagTask>()) > 0);
+    }
+
+    pool->shutdown(IThreadPool::SHUTDOWN_ABORT);
+    TEST_CHECK(pool->is_closed());
+    TEST_CHECK(0 == pool->push(std::make_shared<TestFlagTask>()));
+}
+
+// -----------------------------------------------------------------------------
+
+void
+test_readiness()
+{
+    const int NUM_THREADS = 2;
+    const int NUM_TASKS = 1000;
+
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(NUM_THREADS));
+    int fd = pool->readiness_fd();
+
+    for (int i = 0; i < NUM_TASKS; ++i)
+    {
+        TEST_CHECK(pool->push(std::make_shared<TestEmptyTask>()) > 0);
+    }
+
+    // Event loop collecting the executed tasks:
+    int collected = 0;
+    while (collected < NUM_TASKS)
+    {
+        struct pollfd poll_fd;
+        poll_fd.fd = fd;
+        poll_fd.events = POLLIN;
+        poll_fd.revents = 0;
+        TEST_CHECK(1 == ::poll(&poll_fd, 1, 10000));
+
+        pool->clear_readiness();
+
+        Task task;
+        while (pool->pop(task, false) > 0)
+        {
+            ++collected;
+        }
+    }
+
+    pool->join();
+}
+
+// -----------------------------------------------------------------------------
+
+class TestThrowingTask
+        :
+                public ITask
+{
+
+public:
+
+    virtual void
+    execute()
+    {
+        throw std::runtime_error("failure");
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+void
+test_exceptions()
+{
+    const int NUM_THREADS = 2;
+    const int NUM_TASKS = 100;
+
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(NUM_THREADS));
+
+    // The workers survive the failing tasks and keep serving the pool:
+    for (int i = 0; i < NUM_TASKS; ++i)
+    {
+        TEST_CHECK(pool->push(std::make_shared<TestThrowingTask>()) > 0);
+        TEST_CHECK(pool->push(std::make_shared<TestEmptyTask>()) > 0);
+    }
+
+    int failed = 0;
+    for (int i = 0; i < 2 * NUM_TASKS; ++i)
+    {
+        Task task;
+        TEST_CHECK(pool->pop(task, true) > 0);
+
+        bool throwing = (nullptr != dynamic_cast<TestThrowingTask *>(
+                task.get()));
+        TEST_CHECK(throwing == task->has_failed());
+        if (task->has_failed())
+        {
+            ++failed;
+            bool rethrown = false;
+            try
+            {
+                task->rethrow_if_failed();
+            }
+            catch (const std::runtime_error &)
+            {
+                rethrown = true;
+            }
+            TEST_CHECK(rethrown);
+        }
+    }
+    TEST_CHECK(NUM_TASKS == failed);
+
+    ThreadPoolStats stats;
+    pool->stats(stats);
+    TEST_CHECK(2 * NUM_TASKS == stats.completed);
+    TEST_CHECK(NUM_TASKS == stats.failed);
+
+    pool->join();
+}
+
+// -----------------------------------------------------------------------------
+
+class TestCancellableTask
+        :
+                public ITask
+{
+
+    const std::atomic<bool> *m_gate;
+
+public:
+
+    std::atomic<bool> m_started;
+    bool m_executed;
+    bool m_cancel_called;
+
+    explicit TestCancellableTask(const std::atomic<bool> *gate = nullptr)
+            :
+            m_gate(gate),
+            m_started(false),
+            m_executed(false),
+            m_cancel_called(false)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        m_started = true;
+
+        // Runs until the gate opens or the task is cancelled:
+        while (m_gate != nullptr && !m_gate->load() && !is_cancelled())
+        {
+            sched_yield();
+        }
+
+        m_executed = true;
+    }
+
+    virtual void
+    cancel()
+    {
+        m_cancel_called = true;
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+void
+test_cancellation()
+{
+    const int NUM_TASKS = 100;
+
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(1));
+
+    // Keeps the only worker busy while the other tasks are queued:
+    std::atomic<bool> gate(false);
+    auto blocker = std::make_shared<TestCancellableTask>(&gate);
+    TEST_CHECK(pool->push(blocker) > 0);
+
+    CancellationToken token;
+    for (int i = 0; i < NUM_TASKS; ++i)
+    {
+        auto task = std::make_shared<TestCancellableTask>();
+        task->set_cancellation_token(token);
+        TEST_CHECK(pool->push(task) > 0);
+        TEST_CHECK(pool->push(std::make_shared<TestCancellableTask>()) > 0);
+    }
+
+    token.cancel();
+    TEST_CHECK(token.is_cancelled());
+    gate = true;
+
+    int skipped = 0;
+    std::shared_ptr<TestCancellableTask> task;
+    for (int i = 0; i < 2 * NUM_TASKS + 1; ++i)
+    {
+        TEST_CHECK(pool->popT(task, true) > 0);
+        TEST_CHECK(task->is_cancelled() != task->m_executed);
+        TEST_CHECK(task->is_cancelled() == task->m_cancel_called);
+        if (task->is_cancelled())
+        {
+            ++skipped;
+        }
+    }
+    TEST_CHECK(NUM_TASKS == skipped);
+
+    ThreadPoolStats stats;
+    pool->stats(stats);
+    TEST_CHECK(NUM_TASKS == stats.cancelled);
+    TEST_CHECK(NUM_TASKS + 1 == stats.completed);
+
+    // A running task polls its token:
+    CancellationToken running_token;
+    std::atomic<bool> closed_gate(false);
+    auto running = std::make_shared<TestCancellableTask>(&closed_gate);
+    running->set_cancellation_token(running_token);
+    TEST_CHECK(pool->push(running) > 0);
+    while (!running->m_started)
+    {
+        sched_yield();
+    }
+    running_token.cancel();
+    TEST_CHECK(pool->popT(task, true) > 0);
+    TEST_CHECK(task == running);
+    TEST_CHECK(task->m_executed);
+    TEST_CHECK(!task->m_cancel_called);
+
+    pool->join();
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+ * Opens the gate once a push is blocked on the pool.
+ */
+class TestUnblockTask
+        :
+                public ITask
+{
+
+    IThreadPool &m_pool;
+    std::atomic<bool> &m_gate;
+
+public:
+
+    TestUnblockTask(IThreadPool &pool, std::atomic<bool> &gate)
+            :
+            m_pool(pool),
+            m_gate(gate)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        ThreadPoolStats stats;
+        do
+        {
+            sched_yield();
+            m_pool.stats(stats);
+        }
+        while (0 == stats.blocked);
+
+        m_gate = true;
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+const std::size_t REJECTION_CAPACITY = 2;
+
+/**
+ * Creates a pool with one busy worker and a full queue.
+ */
+IThreadPool *
+create_full_pool(ThreadPoolOptions::RejectionPolicy policy,
+                 const std::atomic<bool> &gate,
+                 std::vector<std::shared_ptr<TestCancellableTask> > &queued)
+{
+    ThreadPoolOptions options(1, REJECTION_CAPACITY);
+    options.rejection_policy = policy;
+    IThreadPool *pool = IThreadPool::create(options);
+
+    auto blocker = std::make_shared<TestCancellableTask>(&gate);
+    TEST_CHECK(pool->push(blocker) > 0);
+    while (!blocker->m_started)
+    {
+        sched_yield();
+    }
+
+    for (std::size_t i = 0; i < REJECTION_CAPACITY; ++i)
+    {
+        queued.push_back(std::make_shared<TestCancellableTask>());
+        TEST_CHECK(pool->push(queued.back()) > 0);
+    }
+
+    return pool;
+}
+
+// -----------------------------------------------------------------------------
+
+void
+test_rejection()
+{
+    std::vector<std::shared_ptr<TestCancellableTask> > queued;
+    auto task = std::make_shared<TestCancellableTask>();
+    ThreadPoolStats stats;
+
+    // Fail:
+    {
+        std::atomic<bool> gate(false);
+        std::unique_ptr<IThreadPool> pool(create_full_pool(
+                ThreadPoolOptions::REJECT_FAIL, gate, queued));
+        TEST_CHECK(0 == pool->push(task));
+        TEST_CHECK(!task->m_executed && !task->m_cancel_called);
+
+        pool->stats(stats);
+        TEST_CHECK(1 == stats.rejected);
+        TEST_CHECK(0 == stats.dropped);
+
+        gate = true;
+        pool->shutdown(IThreadPool::SHUTDOWN_DRAIN);
+    }
+
+    // Caller runs:
+    {
+        std::atomic<bool> gate(false);
+        std::unique_ptr<IThreadPool> pool(create_full_pool(
+                ThreadPoolOptions::REJECT_CALLER_RUNS, gate, queued));
+        TEST_CHECK(pool->push(task) > 0);
+        TEST_CHECK(task->m_executed);
+
+        // Executed ones are collected as usual:
+        std::shared_ptr<TestCancellableTask> popped;
+        TEST_CHECK(pool->popT(popped, true) > 0);
+        TEST_CHECK(popped == task);
+
+        pool->stats(stats);
+        TEST_CHECK(1 == stats.caller_runs);
+        TEST_CHECK(0 == stats.rejected);
+
+        gate = true;
+        pool->shutdown(IThreadPool::SHUTDOWN_DRAIN);
+    }
+
+    // Drop newest:
+    {
+        task = std::make_shared<TestCancellableTask>();
+        std::atomic<bool> gate(false);
+        std::unique_ptr<IThreadPool> pool(create_full_pool(
+                ThreadPoolOptions::REJECT_DROP_NEWEST, gate, queued));
+        TEST_CHECK(0 == pool->push(task));
+        TEST_CHECK(task->is_cancelled() && task->m_cancel_called);
+
+        pool->stats(stats);
+        TEST_CHECK(1 == stats.dropped);
+        TEST_CHECK(1 == stats.rejected);
+
+        gate = true;
+        pool->shutdown(IThreadPool::SHUTDOWN_DRAIN);
+    }
+
+    // Drop oldest:
+    {
+        queued.clear();
+        task = std::make_shared<TestCancellableTask>();
+        std::atomic<bool> gate(false);
+        std::unique_ptr<IThreadPool> pool(create_full_pool(
+                ThreadPoolOptions::REJECT_DROP_OLDEST, gate, queued));
+        TEST_CHECK(pool->push(task) > 0);
+        TEST_CHECK(queued.front()->is_cancelled());
+        TEST_CHECK(queued.front()->m_cancel_called);
+
+        pool->stats(stats);
+        TEST_CHECK(1 == stats.dropped);
+        TEST_CHECK(0 == stats.rejected);
+
+        gate = true;
+        pool->shutdown(IThreadPool::SHUTDOWN_DRAIN);
+        TEST_CHECK(task->m_executed);
+        TEST_CHECK(!queued.front()->m_executed);
+    }
+
+    // Block:
+    {
+        task = std::make_shared<TestCancellableTask>();
+        std::atomic<bool> gate(false);
+        std::unique_ptr<IThreadPool> pool(create_full_pool(
+                ThreadPoolOptions::REJECT_BLOCK, gate, queued));
+        Thread unblock(IThread::create(
+                std::make_shared<TestUnblockTask>(*pool, gate)));
+        TEST_CHECK(pool->push(task) > 0);
+        unblock->join();
+
+        pool->stats(stats);
+        TEST_CHECK(1 == stats.blocked);
+        TEST_CHECK(0 == stats.rejected);
+
+        pool->shutdown(IThreadPool::SHUTDOWN_DRAIN);
+        TEST_CHECK(task->m_executed);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+ * Records the order of execution, for pools with one worker.
+ */
+class TestOrderTask
+        :
+                public TestCancellableTask
+{
+
+    int m_id;
+    std::vector<int> &m_order;
+
+public:
+
+    TestOrderTask(int id, std::vector<int> &order)
+            :
+            m_id(id),
+            m_order(order)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        TestCancellableTask::execute();
+        m_order.push_back(m_id);
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+// Dropping the oldest task spares the tasks with a deadline, and the most
+// urgent of them:
+void
+test_drop_oldest_deadlines()
+{
+    const std::uint64_t SECOND_NS = 1000000000;
+
+    ThreadPoolOptions options(1, REJECTION_CAPACITY);
+    options.rejection_policy = ThreadPoolOptions::REJECT_DROP_OLDEST;
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(options));
+
+    std::atomic<bool> gate(false);
+    auto blocker = std::make_shared<TestCancellableTask>(&gate);
+    TEST_CHECK(pool->push(blocker) > 0);
+    while (!blocker->m_started)
+    {
+        sched_yield();
+    }
+
+    std::uint64_t now = clock_now_ns();
+    auto first = std::make_shared<TestCancellableTask>();
+    auto second = std::make_shared<TestCancellableTask>();
+    auto third = std::make_shared<TestCancellableTask>();
+    auto plain = std::make_shared<TestCancellableTask>();
+    TEST_CHECK(pool->push(first, now + 1 * SECOND_NS) > 0);
+    TEST_CHECK(pool->push(third, now + 3 * SECOND_NS) > 0);
+
+    // Only tasks with a deadline are queued, the latest one is dropped:
+    TEST_CHECK(pool->push(plain) > 0);
+    TEST_CHECK(third->is_cancelled());
+
+    // The task without a deadline goes first:
+    TEST_CHECK(pool->push(second, now + 2 * SECOND_NS) > 0);
+    TEST_CHECK(plain->is_cancelled());
+    TEST_CHECK(!first->is_cancelled());
+
+    ThreadPoolStats stats;
+    pool->stats(stats);
+    TEST_CHECK(2 == stats.dropped);
+
+    gate = true;
+    pool->shutdown(IThreadPool::SHUTDOWN_DRAIN);
+    TEST_CHECK(first->m_executed);
+    TEST_CHECK(second->m_executed);
+    TEST_CHECK(!third->m_executed);
+    TEST_CHECK(!plain->m_executed);
+}
+
+// -----------------------------------------------------------------------------
+
+void
+test_deadlines()
+{
+    const std::uint64_t SECOND_NS = 1000000000;
+
+    ThreadPoolOptions options(1);
+    options.drop_expired = true;
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(options));
+
+    std::atomic<bool> gate(false);
+    auto blocker = std::make_shared<TestCancellableTask>(&gate);
+    TEST_CHECK(pool->push(blocker) > 0);
+
+    // Executed earliest deadline first, ahead of the tasks without one:
+    std::vector<int> order;
+    std::uint64_t now = clock_now_ns();
+    TEST_CHECK(pool->push(std::make_shared<TestOrderTask>(0, order)) > 0);
+    TEST_CHECK(pool->push(std::make_shared<TestOrderTask>(3, order),
+                          now + 3 * SECOND_NS) > 0);
+    TEST_CHECK(pool->push(std::make_shared<TestOrderTask>(1, order),
+                          now + 1 * SECOND_NS) > 0);
+    TEST_CHECK(pool->push(std::make_shared<TestOrderTask>(2, order),
+                          now + 2 * SECOND_NS) > 0);
+
+    // Already over when the worker fetches it:
+    auto expired = std::make_shared<TestOrderTask>(-1, order);
+    TEST_CHECK(pool->push(expired, now) > 0);
+    TEST_CHECK(now == expired->deadline_ns());
+
+    gate = true;
+    Task task;
+    for (int i = 0; i < 6; ++i)
+    {
+        TEST_CHECK(pool->pop(task, true) > 0);
+    }
+
+    TEST_CHECK(4 == order.size());
+    for (int i = 0; i < 3; ++i)
+    {
+        TEST_CHECK(i + 1 == order[i]);
+    }
+    TEST_CHECK(0 == order[3]);
+    TEST_CHECK(expired->is_cancelled());
+    TEST_CHECK(expired->m_cancel_called);
+    TEST_CHECK(!expired->m_executed);
+
+    ThreadPoolStats stats;
+    pool->stats(stats);
+    TEST_CHECK(1 == stats.expired);
+    TEST_CHECK(0 == stats.missed);
+    TEST_CHECK(0 == stats.cancelled);
+    TEST_CHECK(5 == stats.completed);
+
+    // Without dropping, the late ones are executed and counted:
+    std::unique_ptr<IThreadPool> late_pool(IThreadPool::create(1));
+    auto late = std::make_shared<TestCancellableTask>();
+    TEST_CHECK(late_pool->push(late, clock_now_ns()) > 0);
+    TEST_CHECK(late_pool->pop(task, true) > 0);
+    TEST_CHECK(late->m_executed);
+
+    late_pool->stats(stats);
+    TEST_CHECK(1 == stats.missed);
+    TEST_CHECK(0 == stats.expired);
+
+    late_pool->join();
+    pool->join();
+}
+
+// -----------------------------------------------------------------------------
+
+/**
+ * Pushes its children into the pool running it, then optionally waits for a
+ * gate to open.
+ */
+class TestSpawnTask
+        :
+                public TestOrderTask
+{
+
+    IThreadPool &m_pool;
+    std::vector<Task> m_children;
+    const std::atomic<bool> *m_hold;
+
+public:
+
+    std::atomic<bool> m_spawned;
+
+    TestSpawnTask(int id,
+                  std::vector<int> &order,
+                  IThreadPool &pool,
+                  const std::vector<Task> &children,
+                  const std::atomic<bool> *hold = nullptr)
+            :
+            TestOrderTask(id, order),
+            m_pool(pool),
+            m_children(children),
+            m_hold(hold),
+            m_spawned(false)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        TestOrderTask::execute();
+
+        for (auto &child: m_children)
+        {
+            TEST_CHECK(m_pool.push(child) > 0);
+        }
+        m_spawned = true;
+
+        while (m_hold != nullptr && !m_hold->load())
+        {
+            sched_yield();
+        }
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+void
+test_local_slot()
+{
+    ThreadPoolOptions options(1);
+    options.local_slot = true;
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(options));
+
+    std::atomic<bool> gate(false);
+    TEST_CHECK(pool->push(std::make_shared<TestCancellableTask>(&gate)) > 0);
+
+    // The last child runs next, the others queue behind the external tasks:
+    std::vector<int> order;
+    std::vector<Task> children;
+    for (int i = 10; i < 13; ++i)
+    {
+        children.push_back(std::make_shared<TestOrderTask>(i, order));
+    }
+    TEST_CHECK(pool->push(std::make_shared<TestSpawnTask>(0, order, *pool,
+                                                          children)) > 0);
+    TEST_CHECK(pool->push(std::make_shared<TestOrderTask>(1, order)) > 0);
+    TEST_CHECK(pool->push(std::make_shared<TestOrderTask>(2, order)) > 0);
+
+    gate = true;
+    Task task;
+    for (int i = 0; i < 7; ++i)
+    {
+        TEST_CHECK(pool->pop(task, true) > 0);
+    }
+
+    const int expected[] = {0, 12, 1, 2, 10, 11};
+    TEST_CHECK(6 == order.size());
+    for (int i = 0; i < 6; ++i)
+    {
+        TEST_CHECK(expected[i] == order[i]);
+    }
+
+    ThreadPoolStats stats;
+    pool->stats(stats);
+    TEST_CHECK(1 == stats.workers[0].local);
+    TEST_CHECK(7 == stats.submitted);
+    TEST_CHECK(7 == stats.completed);
+
+    // The task left into the slot is cancelled by the abort:
+    std::atomic<bool> hold(false);
+    auto child = std::make_shared<TestCancellableTask>();
+    auto parent = std::make_shared<TestSpawnTask>(
+            0, order, *pool, std::vector<Task>(1, child), &hold);
+    TEST_CHECK(pool->push(parent) > 0);
+    while (!parent->m_spawned)
+    {
+        sched_yield();
+    }
+
+    pool->cancel();
+    hold = true;
+    pool->join();
+    TEST_CHECK(child->is_cancelled());
+    TEST_CHECK(child->m_cancel_called);
+    TEST_CHECK(!child->m_executed);
+}
+
+// -----------------------------------------------------------------------------
+
+void
+test_wait_strategy()
+{
+    const int NUM_THREADS = 2;
+    const int NUM_TASKS = 1000;
+
+    // Workers and collector poll before parking:
+    ThreadPoolOptions options(NUM_THREADS);
+    options.wait_strategy = WaitStrategy(100, 100, 10);
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(options));
+
+    Task task;
+    for (int i = 0; i < NUM_TASKS; ++i)
+    {
+        TEST_CHECK(pool->push(std::make_shared<TestEmptyTask>()) > 0);
+        TEST_CHECK(pool->pop(task, true) > 0);
+    }
+
+    pool->shutdown(IThreadPool::SHUTDOWN_DRAIN);
+    TEST_CHECK(0 == pool->pop(task, true));
+
+    ThreadPoolStats stats;
+    pool->stats(stats);
+    TEST_CHECK(NUM_TASKS == stats.completed);
+}
+
+// -----------------------------------------------------------------------------
+
+class TestCpuTask
+        :
+                public ITask
+{
+
+public:
+
+    int m_cpu;
+
+    TestCpuTask()
+            : m_cpu(-1)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        m_cpu = ::sched_getcpu();
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+void
+test_low_latency()
+{
+    const int NUM_TASKS = 20;
+
+    const std::size_t cpu = test_allowed_cpu();
+
+    ThreadPoolOptions options = ThreadPoolOptions::low_latency(
+            std::vector<std::size_t>(1, cpu));
+    TEST_CHECK(1 == options.num_threads);
+    TEST_CHECK(options.lock_memory);
+    TEST_CHECK(!options.wait_strategy.parks_immediately());
+
+    // Would lock the memory of the whole test process for good:
+    options.lock_memory = false;
+
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(options));
+
+    // The only worker runs on the reserved processor:
+    std::shared_ptr<TestCpuTask> task;
+    for (int i = 0; i < NUM_TASKS; ++i)
+    {
+        TEST_CHECK(pool->push(std::make_shared<TestCpuTask>()) > 0);
+        TEST_CHECK(pool->popT(task, true) > 0);
+#ifdef __linux__
+        TEST_CHECK(int(cpu) == task->m_cpu);
+#endif
+    }
+
+    // Polling workers are released by the shutdown:
+    pool->shutdown(IThreadPool::SHUTDOWN_DRAIN);
+    TEST_CHECK(0 == pool->popT(task, true));
+}
+
+// -----------------------------------------------------------------------------
+
+// Waits inside a blocking region for another task to release it:
+class TestBlockedTask
+        :
+                public ITask
+{
+
+    const std::atomic<bool> &m_release;
+
+public:
+
+    bool m_released;
+
+    explicit TestBlockedTask(const std::atomic<bool> &release)
+            :
+            m_release(release),
+            m_released(false)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        BlockingRegion region;
+
+        // Gives up after a while rather than hanging the test:
+        std::uint64_t timeout = clock_now_ns() + 5000000000ull;
+        while (!m_release.load() && clock_now_ns() < timeout)
+        {
+            sched_yield();
+        }
+        m_released = m_release.load();
+    }
+
+};
+
+class TestReleaseTask
+        :
+                public ITask
+{
+
+    std::atomic<bool> &m_release;
+
+public:
+
+    explicit TestReleaseTask(std::atomic<bool> &release)
+            : m_release(release)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        m_release = true;
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+void
+test_blocking_region()
+{
+    const int NUM_ROUNDS = 3;
+
+    // Has no effect outside of a pool:
+    {
+        BlockingRegion region;
+    }
+
+    ThreadPoolOptions options(1);
+    options.max_spare_threads = 1;
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(options));
+
+    // The only worker is blocked, a spare thread runs the releasing task:
+    for (int i = 0; i < NUM_ROUNDS; ++i)
+    {
+        std::atomic<bool> release(false);
+        auto blocked = std::make_shared<TestBlockedTask>(release);
+        TEST_CHECK(pool->push(blocked) > 0);
+        TEST_CHECK(pool->push(std::make_shared<TestReleaseTask>(release)) > 0);
+
+        for (int j = 0; j < 2; ++j)
+        {
+            Task task;
+            TEST_CHECK(pool->pop(task, true) > 0);
+        }
+        TEST_CHECK(blocked->m_released);
+    }
+
+    ThreadPoolStats stats;
+    pool->stats(stats);
+    TEST_CHECK(1 == stats.workers.size());
+    TEST_CHECK(2 * NUM_ROUNDS == stats.completed);
+    TEST_CHECK(stats.spawned >= 1);
+    TEST_CHECK(stats.spawned <= NUM_ROUNDS);
+
+    pool->shutdown(IThreadPool::SHUTDOWN_DRAIN);
+}
+
+// -----------------------------------------------------------------------------
+
+// Pops from the pool, concurrently with other consumers, until all the
+// tasks have been collected:
+class TestConsumerTask
+        :
+                public ITask
+{
+
+    IThreadPool &m_pool;
+    std::atomic<std::size_t> &m_collected;
+    std::size_t m_total;
+
+public:
+
+    bool m_consistent;
+
+    TestConsumerTask(IThreadPool &pool,
+                     std::atomic<std::size_t> &collected,
+                     std::size_t total)
+            :
+            m_pool(pool),
+            m_collected(collected),
+            m_total(total),
+            m_consistent(true)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        std::deque<Task> tasks;
+        while (m_collected.load() < m_total)
+        {
+            Task task;
+            if (m_pool.pop(task, false) > 0)
+            {
+                m_consistent = m_consistent && task;
+                m_collected.fetch_add(1);
+            }
+            else
+            {
+                // A task popped for nothing would be lost:
+                m_consistent = m_consistent && !task;
+            }
+
+            tasks.clear();
+            std::size_t count = m_pool.pop_all(tasks, 2, false);
+            m_consistent = m_consistent && count == tasks.size();
+            m_collected.fetch_add(count);
+
+            sched_yield();
+        }
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+void
+test_concurrent_pop()
+{
+    const std::size_t NUM_TASKS = 20000;
+    const std::size_t NUM_CONSUMERS = 3;
+
+    std::unique_ptr<IThreadPool> pool(IThreadPool::create(2));
+
+    std::deque<Task> tasks;
+    TEST_CHECK(0 == pool->pop_all(tasks, 0, true));
+
+    std::atomic<std::size_t> collected(0);
+    std::vector<std::shared_ptr<TestConsumerTask> > consumers;
+    std::vector<Thread> threads;
+    for (std::size_t i = 0; i < NUM_CONSUMERS; ++i)
+    {
+        consumers.push_back(std::make_shared<TestConsumerTask>(
+                *pool, collected, NUM_TASKS));
+        threads.push_back(IThread::create(consumers.back()));
+    }
+
+    for (std::size_t i = 0; i < NUM_TASKS; ++i)
+    {
+        TEST_CHECK(pool->push(std::make_shared<TestCpuTask>()) > 0);
+    }
+
+    for (std::size_t i = 0; i < NUM_CONSUMERS; ++i)
+    {
+        threads[i]->join();
+        TEST_CHECK(consumers[i]->m_consistent);
+    }
+
+    // Each task popped exactly once:
+    TEST_CHECK(NUM_TASKS == collected.load());
+    Task task;
+    TEST_CHECK(0 == pool->pop(task, false));
+
+    pool->shutdown(IThreadPool::SHUTDOWN_DRAIN);
+}
+
+// -----------------------------------------------------------------------------
+
+void
+test_completion_order()
+{
+    // Either worker may take the first task, so that both merge orders of
+    // the buffers are likely to be exercised:
+    const int NUM_ROUNDS = 4;
+
+    for (int round = 0; round < NUM_ROUNDS; ++round)
+    {
+        std::unique_ptr<IThreadPool> pool(IThreadPool::create(2));
+
+        // The first task holds its worker until the other one has completed
+        // the second task and fetched the releasing one:
+        std::atomic<bool> gate(false);
+        auto first = std::make_shared<TestCancellableTask>(&gate);
+        auto second = std::make_shared<TestEmptyTask>();
+        TEST_CHECK(pool->push(first) > 0);
+        TEST_CHECK(pool->push(second) > 0);
+        TEST_CHECK(pool->post(std::make_shared<TestReleaseTask>(gate)) > 0);
+
+        // Both tasks are in the buffers of their workers once drained:
+        pool->shutdown(IThreadPool::SHUTDOWN_DRAIN);
+
+        std::deque<Task> tasks;
+        TEST_CHECK(2 == pool->pop_all(tasks, 2, false));
+        TEST_CHECK(second == tasks[0]);
+        TEST_CHECK(first == tasks[1]);
+    }
+}
+
+} // anonymous namespace
+
+// -----------------------------------------------------------------------------
+
+void
+test_ThreadPool()
+{
+    test_base();
+    test_timeline();
+    test_stats();
+    test_post();
+    test_shutdown();
+    test_readiness();
+    test_exceptions();
+    test_cancellation();
+    test_rejection();
+    test_deadlines();
+    test_drop_oldest_deadlines();
+    test_local_slot();
+    test_wait_strategy();
+    test_low_latency();
+    test_blocking_region();
+    test_concurrent_pop();
+    test_completion_order();
+}
+
+// -----------------------------------------------------------------------------
@@ -0,0 +1,166 @@
+/**
+Copyright (c) 2013, Riccardo Ressi
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+Redistributions of source code must retain the above copyright notice, this list
+of conditions and the following disclaimer.
+Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+Neither the name of Riccardo Ressi nor the names of its contributors may be
+used to endorse or promote products derived from this software without specific
+prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Trace.h"
+#include "test_Utils.h"
+
+#include "Thread.h"
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+namespace {
+
+const std::uint32_t TEST_EVENT = 42;
+
+class TestEventTask
+        :
+                public ITask
+{
+
+    int m_num_events;
+
+public:
+
+    explicit TestEventTask(int num_events)
+            :
+            m_num_events(num_events)
+    {
+    }
+
+    virtual void
+    execute()
+    {
+        for (int i = 0; i < m_num_events; ++i)
+        {
+            trace_event(TEST_EVENT, std::uint64_t(i), 7);
+        }
+    }
+
+};
+
+// -----------------------------------------------------------------------------
+
+void
+test_binary()
+{
+    const int NUM_THREADS = 4;
+    const int NUM_EVENTS = 1000;
+    const char *PATH = "tp-ut-trace.bin";
+
+    // Not recorded, the binary tracing is not active yet:
+    trace_event(TEST_EVENT);
+
+    TEST_CHECK(trace_open(PATH));
+    TEST_CHECK(!trace_open(PATH));
+    {
+        std::vector<Thread> threads;
+        for (int i = 0; i < NUM_THREADS; ++i)
+        {
+            Task task = std::make_shared<TestEventTask>(NUM_EVENTS);
+            threads.push_back(IThread::create(task));
+        }
+
+        for (auto &thread: threads)
+        {
+            thread->join();
+        }
+    }
+    trace_close();
+
+    std::FILE *file = std::fopen(PATH, "rb");
+    TEST_CHECK(file != nullptr);
+
+    char magic[sizeof(TRACE_FILE_MAGIC) - 1];
+    TEST_CHECK(std::fread(magic, 1, sizeof(magic), file) == sizeof(magic));
+    TEST_CHECK(std::memcmp(magic, TRACE_FILE_MAGIC, sizeof(magic)) == 0);
+
+    // Records of each thread are in order:
+    std::map<std::uint32_t, std::uint64_t> next_arg;
+    std::size_t num_records = 0;
+
+    TraceRecord record;
+    while (std::fread(&record, sizeof(record), 1, file) == 1)
+    {
+        TEST_CHECK(record.event_id == TEST_EVENT);
+        TEST_CHECK(record.args[1] == 7);
+        TEST_CHECK(record.args[0] >= next_arg[record.thread_id]);
+        next_arg[record.thread_id] = record.args[0] + 1;
+        ++num_records;
+    }
+
+    std::fclose(file);
+    std::remove(PATH);
+
+    TEST_CHECK(next_arg.size() <= NUM_THREADS);
+    TEST_CHECK(num_records + trace_dropped() == NUM_THREADS * NUM_EVENTS);
+}
+
+// -----------------------------------------------------------------------------
+
+void
+test_macros()
+{
+    int evaluated = 0;
+
+    trace_enable(TRACE_CATEGORY_QUEUE, TRACE_LEVEL_WARNING);
+
+    TRACE_INFO(TRACE_CATEGORY_QUEUE, "not traced " << ++evaluated);
+    TRACE_WARNING(TRACE_CATEGORY_TEST, "not traced " << ++evaluated);
+    TEST_CHECK(0 == evaluated);
+
+    TRACE_WARNING(TRACE_CATEGORY_QUEUE, "traced " << ++evaluated);
+    TRACE_ERROR(TRACE_CATEGORY_QUEUE, "traced " << ++evaluated);
+    TEST_CHECK(2 == evaluated);
+
+    trace_set(false);
+    TRACE_ERROR(TRACE_CATEGORY_ALL, "not traced " << ++evaluated);
+    TEST_CHECK(2 == evaluated);
+
+    trace_set(true);
+    TRACE_DEBUG(TRACE_CATEGORY_TEST, "traced " << ++evaluated);
+    TEST_CHECK(3 == evaluated);
+}
+
+} // anonymous namespace
+
+// -----------------------------------------------------------------------------
+
+void
+test_Trace()
+{
+    test_binary();
+    test_macros();
+}
+
+// -----------------------------------------------------------------------------
@@ -30,8 +30,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef TEST_UTILS_H
 #define TEST_UTILS_H
 
+#include <cstddef>
 #include <sstream>
 
+#include <sched.h>
+
 #define TEST_CHECK(c) \
     if (c != true) \
     { \
@@ -41,4 +44,27 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
         throw std::runtime_error(message.str()); \
     }
 
+// Returns one of the processors the calling thread is allowed to run on,
+// whatever the cpuset of the runner:
+inline std::size_t
+test_allowed_cpu()
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (0 == ::sched_getaffinity(0, sizeof(set), &set))
+    {
+        for (std::size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &set))
+            {
+                return cpu;
+            }
+        }
+    }
+#endif
+
+    return 0;
+}
+
 #endif
\ No newline at end of file